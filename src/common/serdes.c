@@ -186,6 +186,15 @@ uint32_t serdes_get32(struct serdes *sd)
     return v;
 }
 
+uint64_t serdes_get64(struct serdes *sd)
+{
+    uint64_t v;
+
+    v = ((uint64_t) serdes_get32(sd)) << 32;
+    v |= (uint64_t) serdes_get32(sd);
+    return v;
+}
+
 int serdes_get_bool(struct serdes *sd)
 {
     return (int) serdes_get8(sd);
@@ -215,6 +224,14 @@ void serdes_get32_array(struct serdes *sd, uint32_t *arr, size_t num)
     }
 }
 
+void serdes_get64_array(struct serdes *sd, uint64_t *arr, size_t num)
+{
+    size_t i;
+    for (i = 0; i < num; i++) {
+        arr[i] = serdes_get64(sd);
+    }
+}
+
 size_t serdes_get_string(struct serdes *sd, char *str, size_t size)
 {
     size_t i;
@@ -272,6 +289,12 @@ void serdes_put32(struct serdes *sd, uint32_t v)
     sd->pos += 4;
 }
 
+void serdes_put64(struct serdes *sd, uint64_t v)
+{
+    serdes_put32(sd, (uint32_t) (v >> 32));
+    serdes_put32(sd, (uint32_t) v);
+}
+
 void serdes_put_bool(struct serdes *sd, int val)
 {
     serdes_put8(sd, (val) ? 1 : 0);
@@ -301,6 +324,14 @@ void serdes_put32_array(struct serdes *sd, const uint32_t *arr, size_t num)
     }
 }
 
+void serdes_put64_array(struct serdes *sd, const uint64_t *arr, size_t num)
+{
+    size_t i;
+    for (i = 0; i < num; i++) {
+        serdes_put64(sd, arr[i]);
+    }
+}
+
 void serdes_put_string(struct serdes *sd, const char *str)
 {
     size_t i;
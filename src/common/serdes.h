@@ -81,6 +81,11 @@ uint16_t serdes_get16(struct serdes *sd);
  */
 uint32_t serdes_get32(struct serdes *sd);
 
+/* Deserializes an uint64_t value.
+ * Returns the value.
+ */
+uint64_t serdes_get64(struct serdes *sd);
+
 /* Deserializes a boolean value.
  * Returns the value.
  */
@@ -104,6 +109,12 @@ void serdes_get16_array(struct serdes *sd, uint16_t *arr, size_t num);
  */
 void serdes_get32_array(struct serdes *sd, uint32_t *arr, size_t num);
 
+/* Deserializes an array of uint64_t values.
+ * The `arr` is the parameter with the pointer to the array.
+ * The number of elements is given by `num`.
+ */
+void serdes_get64_array(struct serdes *sd, uint64_t *arr, size_t num);
+
 /* Deserializes a string.
  * The string is deserialized into the buffer `str`, which is of size
  * `size`. No more than `size` bytes are written to `str`, including
@@ -127,6 +138,11 @@ void serdes_put16(struct serdes *sd, uint16_t v);
  */
 void serdes_put32(struct serdes *sd, uint32_t v);
 
+/* Serializes an uint64_t value.
+ * The value to serialize is in the parameter `v`.
+ */
+void serdes_put64(struct serdes *sd, uint64_t v);
+
 /* Serializes a boolan value.
  * The value to serialize is in the parameter `v`.
  */
@@ -150,6 +166,12 @@ void serdes_put16_array(struct serdes *sd, const uint16_t *arr, size_t num);
  */
 void serdes_put32_array(struct serdes *sd, const uint32_t *arr, size_t num);
 
+/* Serializes an array of uint64_t values.
+ * The `arr` is the parameter with the pointer to the array.
+ * The number of elements is given by `num`.
+ */
+void serdes_put64_array(struct serdes *sd, const uint64_t *arr, size_t num);
+
 /* Serializes a NUL terminated string.
  * The string is given by the parameter `str`.
  */
@@ -33,6 +33,7 @@
 
 /* Other useful macros. */
 #define __inline__ __inline__
+#define __always_inline__ __inline__ __attribute__((always_inline))
 #define __aligned__(x) __attribute__((aligned (x)))
 #define __restrict__ __restrict__
 
@@ -75,6 +75,45 @@ void get_command(struct debugger *dbg, int *is_eof)
     }
 }
 
+/* Sleeps while the Alto is idle.
+ * It wakes up when there is new input (from the GUI or the network),
+ * and checks whether the GUI is still running at every frame.
+ * The parameters `running` and `stop_sim` are as in gui_running().
+ * Returns TRUE on success.
+ */
+static
+int sleep_while_idle(struct debugger *dbg, int *running, int *stop_sim)
+{
+    int woken;
+
+    while (TRUE) {
+        if (unlikely(!gui_running(dbg->ui, running, stop_sim))) {
+            report_error("debugger: sleep_while_idle: "
+                         "could not determine if GUI is running");
+            return FALSE;
+        }
+        if (!*running || *stop_sim) break;
+
+        if (unlikely(!gui_wait_wakeup(dbg->ui, &woken))) {
+            report_error("debugger: sleep_while_idle: "
+                         "could not wait for input");
+            return FALSE;
+        }
+        if (woken) break;
+    }
+    return TRUE;
+}
+
+/* Obtains the effective cpu frequency (the frequency multiplied by the
+ * cpu clock multiplier).
+ * Returns the effective frequency (in hertz).
+ */
+static
+int64_t effective_frequency(const struct debugger *dbg)
+{
+    return ((int64_t) dbg->frequency) * dbg->sim->sched.clock_mult;
+}
+
 /* Runs the simulation.
  * The parameter `max_steps` specifies the maximum number of steps
  * to run. If `max_steps` is negative, it runs indefinitely. Similarly,
@@ -82,15 +121,17 @@ void get_command(struct debugger *dbg, int *is_eof)
  * Returns TRUE on success.
  */
 static
-int simulate(struct debugger *dbg, int max_steps, int max_cycles)
+int simulate(struct debugger *dbg, int max_steps, int64_t max_cycles)
 {
     const struct breakpoint *bp;
     struct gui *ui;
     struct simulator *sim;
     unsigned int num, max_breakpoints;
-    int32_t prev_cycle;
-    int32_t step, cycle, cycle_mod;
-    int hit, hit1;
+    unsigned int reason;
+    int64_t prev_cycle;
+    int64_t cycle, cycle_mod, budget;
+    int32_t step;
+    int hit, hit1, single_step;
     int running, stop_sim;
 
     /* Get the effective number of breakpoints. */
@@ -105,9 +146,23 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
     ui = dbg->ui;
     sim = dbg->sim;
 
+    /* When counting steps or checking breakpoints, the simulator runs
+     * one microinstruction at a time (a budget of one cycle). Otherwise
+     * it runs in chunks until the next frame.
+     */
+    single_step = (max_steps >= 0) || (max_breakpoints > 0);
+
+    /* The native paths would run many microinstructions in one step,
+     * and they could also go past the requested number of cycles.
+     */
+    simulator_set_single_step(sim, single_step || (max_cycles >= 0));
+
     step = 0;
     cycle = 0;
-    cycle_mod = (int32_t) (dbg->frequency / 60);
+    /* The cpu runs faster than the devices when overclocked, so
+     * there are more cycles in each frame.
+     */
+    cycle_mod = effective_frequency(dbg) / 60;
     running = TRUE;
     stop_sim = FALSE;
     while (TRUE) {
@@ -118,15 +173,38 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
 
         if (sim->error) break;
 
+        if (single_step) {
+            budget = 1;
+        } else {
+            budget = cycle_mod - (sim->cycle % cycle_mod);
+            if ((max_cycles >= 0) && (budget > max_cycles - cycle))
+                budget = max_cycles - cycle;
+        }
+
         prev_cycle = sim->cycle;
-        simulator_step(sim);
-        cycle += INTR_CYCLE(sim->cycle - prev_cycle);
+        cycle += simulator_run(sim, budget, SIM_STOP_FIELD, &reason);
         step++;
 
-        cycle = INTR_CYCLE(cycle);
+        /* Show the display as soon as a field is completed. */
+        if (reason == SIM_STOP_FIELD) {
+            if (unlikely(!gui_update(ui))) {
+                report_error("debugger: simulate: "
+                             "could not update GUI");
+                return FALSE;
+            }
+
+            /* Nothing to simulate until new input arrives. */
+            if (dbg->idle_sleep && simulator_is_idle(sim)) {
+                if (unlikely(!sleep_while_idle(dbg, &running,
+                                               &stop_sim))) {
+                    return FALSE;
+                }
+                if (!running || stop_sim) break;
+            }
+        }
 
         /* Detect when a wraparound happened. */
-        if ((prev_cycle % cycle_mod) > (sim->cycle % cycle_mod)) {
+        if ((prev_cycle / cycle_mod) != (sim->cycle / cycle_mod)) {
             if (unlikely(!gui_running(ui, &running, &stop_sim))) {
                 report_error("debugger: simulate: "
                              "could not determine if GUI is running");
@@ -134,12 +212,8 @@ int simulate(struct debugger *dbg, int max_steps, int max_cycles)
             }
             if (!running || stop_sim) break;
 
-            if (unlikely(!gui_update(ui))) {
-                report_error("debugger: simulate: "
-                             "could not update GUI");
-                return FALSE;
-            }
-            if (unlikely(!gui_wait_frame(ui))) {
+            if (unlikely(!gui_wait_frame(ui, sim->cycle,
+                                         effective_frequency(dbg)))) {
                 report_error("debugger: simulate: "
                              "could not wait for next frame");
                 return FALSE;
@@ -231,18 +305,43 @@ void cmd_change_frequency(struct debugger *dbg)
     arg = (const char *) dbg->cmd_buf;
     arg = &arg[strlen(arg) + 1];
 
-    if (arg[0] == '\0') {
-        printf("please specify the frequency\n");
-        return;
+    if (arg[0] != '\0') {
+        freq = (int) strtoul(arg, (char **) &end, 10);
+        if (end[0] != '\0' || freq <= 0) {
+            printf("invalid decimal number `%s`\n", arg);
+            return;
+        }
+
+        dbg->frequency = freq;
+        printf("frequency changed to %d.\n", freq);
     }
 
-    freq = (int) strtoul(arg, (char **) &end, 10);
-    if (end[0] != '\0' || freq < 0) {
-        printf("invalid decimal number `%s`\n", arg);
+    printf("frequency: %d Hz (x%u clock multiplier, effective %lld Hz)\n",
+           dbg->frequency, dbg->sim->sched.clock_mult,
+           (long long) effective_frequency(dbg));
+}
+
+/* Change the speed of the simulation. */
+static
+void cmd_change_speed(struct debugger *dbg)
+{
+    const char *arg;
+    char buf[32];
+    unsigned int speed;
+
+    arg = (const char *) dbg->cmd_buf;
+    arg = &arg[strlen(arg) + 1];
+
+    if (arg[0] != '\0') {
+        if (!gui_parse_speed(arg, &speed)) {
+            printf("invalid speed `%s`\n", arg);
+            return;
+        }
+        gui_set_speed(dbg->ui, speed);
     }
 
-    dbg->frequency = freq;
-    printf("frequency changed to %d.\n", freq);
+    gui_format_speed(gui_get_speed(dbg->ui), buf, sizeof(buf));
+    printf("speed: %s\n", buf);
 }
 
 /* Processes the registers command.
@@ -486,13 +585,13 @@ static
 int cmd_step(struct debugger *dbg)
 {
     const char *arg, *end;
-    int num;
+    int64_t num;
 
     arg = (const char *) dbg->cmd_buf;
     arg = &arg[strlen(arg) + 1];
 
     if (arg[0] != '\0') {
-        num = (int) strtoul(arg, (char **) &end, 10);
+        num = (int64_t) strtoull(arg, (char **) &end, 10);
         if (end[0] != '\0' || num < 0) {
             printf("invalid decimal number `%s`\n", arg);
             return TRUE;
@@ -1076,7 +1175,8 @@ void cmd_help(struct debugger *dbg)
         printf("Commands:\n");
         printf("  oct              Use octal numbers\n");
         printf("  hex              Use hexadecimal numbers\n");
-        printf("  freq num         Change the cpu frequency\n");
+        printf("  freq [num]       Change the cpu frequency\n");
+        printf("  speed [mode]     Change the simulation speed\n");
         printf("  r                Print the registers\n");
         printf("  nr               Print the NOVA registers\n");
         printf("  e                Print the extra registers\n");
@@ -1121,7 +1221,20 @@ void cmd_help(struct debugger *dbg)
         printf("Changes the frequency:\n");
         printf("  freq [num]\n");
         printf("The frequency (in hertz) is given by `num`. "
-               "In this case `num` is a decimal number.");
+               "In this case `num` is a decimal number.\n");
+        printf("Without `num`, it prints the current frequency and the "
+               "effective frequency (with the clock multiplier).\n");
+        return;
+    }
+
+    if (strcmp(arg, "speed") == 0) {
+        printf("Changes the speed of the simulation:\n");
+        printf("  speed [mode]\n");
+        printf("The `mode` is `realtime`, `max` (as fast as possible) "
+               "or a multiplier `Nx` of the real time (up to %dx).\n",
+               GUI_MAX_SPEED);
+        printf("Without `mode`, it prints the current speed. "
+               "The F11 key also changes the speed.\n");
         return;
     }
 
@@ -1410,6 +1523,11 @@ int debugger_debug(struct gui *ui)
             continue;
         }
 
+        if (strcmp(cmd, "speed") == 0) {
+            cmd_change_speed(dbg);
+            continue;
+        }
+
         if (strcmp(cmd, "r") == 0) {
             cmd_registers(dbg, FALSE);
             continue;
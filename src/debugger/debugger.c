@@ -93,6 +93,7 @@ int debugger_create(struct debugger *dbg, int use_debugger,
     dbg->frequency = 6300000; /* 6.3 MHz */
     dbg->use_octal = TRUE;
     dbg->use_debugger = use_debugger;
+    dbg->idle_sleep = FALSE;
     dbg->sim = sim;
     dbg->ui = ui;
 
@@ -51,6 +51,9 @@ struct debugger {
 
     struct string_buffer output;  /* The string buffer for output. */
     int use_debugger;             /* To use the debugger. */
+    int idle_sleep;               /* To sleep while the Alto is idle
+                                   * (emulated time stops meanwhile).
+                                   */
 
     struct decoder dec;           /* Decoder used. */
     struct value_decoder vdecs[2]; /* Used by the decoder. */
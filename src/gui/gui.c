@@ -1,18 +1,55 @@
 
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 #include <SDL.h>
 #include <signal.h>
 
 #include "gui/gui.h"
+#include "gui/script.h"
 #include "simulator/display.h"
 #include "simulator/keyboard.h"
 #include "simulator/mouse.h"
 #include "common/utils.h"
 
+/* Constants. */
+#define NUM_BUFFERS                        3  /* For triple buffering. */
+#define BUFFER_INDEX_MASK                  3
+#define BUFFER_FRESH                       4  /* Not taken by the reader. */
+#define FRAME_RATE                        60  /* Frames per second. */
+#define MAX_FRAME_LAG_MS                 100  /* Lag to stop catching up. */
+#define HOTKEY_MAX_SPEED                   8  /* F11 cycles up to 8x. */
+#define TITLE_SIZE                        80
+
 /* Data structures and types. */
 
+/* A frame of the display (handed from the simulation thread
+ * to the gui thread).
+ */
+struct gui_frame {
+    struct display_line *lines;   /* The lines of the display. */
+    uint32_t changed[DISPLAY_DIRTY_WORDS];
+                                  /* The lines that changed since the
+                                   * last frame taken by the gui thread.
+                                   */
+    uint32_t stale[DISPLAY_DIRTY_WORDS];
+                                  /* The lines that are out of date
+                                   * (only used by the simulation
+                                   * thread).
+                                   */
+};
+
+/* A snapshot of the input state (handed from the gui thread
+ * to the simulation thread).
+ */
+struct gui_input {
+    struct keyboard keyb;         /* The pressed keys. */
+    struct mouse mous;            /* The pressed buttons and the total
+                                   * movement of the mouse.
+                                   */
+};
+
 /* Internal structure for the user interface. */
 struct gui_internal {
     int initialized;              /* If this structure was initialized. */
@@ -20,16 +57,89 @@ struct gui_internal {
     int stop_sim;                 /* A request to stop the simulation
                                    * was issued.
                                    */
+    int headless;                 /* Running without user interface. */
+    int use_script;               /* The input comes from `scr`. */
+    struct script scr;            /* The input script (headless). */
+
+    /* The frames are triple buffered: the simulation thread writes
+     * the back frame and publishes it by swapping it with the middle
+     * frame, and the gui thread takes the middle frame (if it is newer)
+     * by swapping it with the front frame. None of them ever waits for
+     * the other. The input snapshots are handed over in the same way,
+     * in the other direction.
+     */
+    struct gui_frame frames[NUM_BUFFERS];
+                                  /* The frames of the triple buffer. */
+    SDL_atomic_t frame_state;     /* The index of the middle frame, and
+                                   * BUFFER_FRESH if it was not taken.
+                                   */
+    int frame_back;               /* The back frame (simulation). */
+    int frame_front;              /* The front frame (gui). */
+    struct display_line *lines;   /* The lines of the display
+                                   * (simulation).
+                                   */
+    uint32_t new_dirty[DISPLAY_DIRTY_WORDS];
+                                  /* The lines that changed since the
+                                   * last frame was published
+                                   * (simulation).
+                                   */
+    uint32_t unseen[DISPLAY_DIRTY_WORDS];
+                                  /* The lines that changed since the
+                                   * last frame known to be taken by
+                                   * the gui thread (simulation).
+                                   */
+    uint32_t dirty[DISPLAY_DIRTY_WORDS];
+                                  /* The lines of the front frame not
+                                   * yet uploaded to the texture (gui).
+                                   */
+    uint64_t frame_counter;       /* The host clock when the last frame
+                                   * was published (simulation).
+                                   */
+
+    /* The simulation is paced by the host clock (in performance counter
+     * ticks) against the simulated cycles elapsed since a reference
+     * point, which is restarted whenever the speed or the frequency
+     * changes, or when the simulation falls too far behind.
+     */
+    SDL_atomic_t speed;           /* The speed (see gui_set_speed()). */
+    unsigned int pace_speed;      /* The speed at the reference
+                                   * (simulation).
+                                   */
+    int64_t pace_frequency;       /* The cpu frequency at the reference
+                                   * (or 0 if there is no reference).
+                                   */
+    int64_t pace_cycle;           /* The cycle at the reference. */
+    uint64_t pace_counter;        /* The host clock at the reference. */
+    unsigned int title_speed;     /* The speed shown in the title (gui). */
+
+    struct keyboard keyb;         /* The (fake) keyboard (gui). */
+    struct mouse mous;            /* The (fake) mouse (gui). The
+                                   * movement is never cleared.
+                                   */
+    int input_changed;            /* New input arrived since the last
+                                   * snapshot was published (gui).
+                                   */
+    struct gui_input inputs[NUM_BUFFERS];
+                                  /* The input snapshots. */
+    SDL_atomic_t input_state;     /* The index of the middle snapshot,
+                                   * and BUFFER_FRESH if not taken.
+                                   */
+    int input_back;               /* The back snapshot (gui). */
+    int input_front;              /* The front snapshot (simulation). */
+    int16_t seen_dx, seen_dy;     /* The mouse movement already passed
+                                   * to the simulator (simulation).
+                                   */
 
-    uint8_t *display_data;        /* The display pixels. */
-    struct keyboard keyb;         /* The (fake) keyboard. */
-    struct mouse mous;            /* The (fake) mouse. */
     SDL_mutex *mutex;             /* Mutex for synchronization between
-                                   * threads of the keyboard, mouse
-                                   * and the screen pixels.
+                                   * threads of the running state and
+                                   * the wake ups.
+                                   */
+    SDL_cond *wake_cond;          /* A condition that signals that the
+                                   * simulation should wake up (because
+                                   * of new input or a new frame).
                                    */
-    SDL_cond *frame_cond;         /* A condition that signals
-                                   * that a new frame is being drawn.
+    int wakeup;                   /* New input arrived since the last
+                                   * call to gui_wait_wakeup().
                                    */
 
     SDL_Window *window;           /* The interface window. */
@@ -57,6 +167,42 @@ static struct gui_internal *suil;/* A list of gui_internal objects to notify
 
 /* Functions. */
 
+/* Publishes the back buffer of a triple buffer.
+ * The parameter `state` is the shared state of the triple buffer, and
+ * `back` is the index of the back buffer. It returns the index of the
+ * new back buffer.
+ * Returns TRUE if the buffer published previously was never taken.
+ */
+static
+int buffer_publish(SDL_atomic_t *state, int *back)
+{
+    int old;
+
+    old = SDL_AtomicSet(state, *back | BUFFER_FRESH);
+    *back = old & BUFFER_INDEX_MASK;
+    return ((old & BUFFER_FRESH) != 0);
+}
+
+/* Takes the newest buffer published in a triple buffer (if any).
+ * The parameter `state` is the shared state of the triple buffer, and
+ * `front` is the index of the front buffer. It returns the index of the
+ * buffer taken.
+ * Returns TRUE if a new buffer was taken.
+ */
+static
+int buffer_take(SDL_atomic_t *state, int *front)
+{
+    int cur;
+
+    while (TRUE) {
+        cur = SDL_AtomicGet(state);
+        if (!(cur & BUFFER_FRESH)) return FALSE;
+        if (SDL_AtomicCAS(state, cur, *front)) break;
+    }
+    *front = cur & BUFFER_INDEX_MASK;
+    return TRUE;
+}
+
 /* Signal handler for SIGINT type signals. */
 static
 void handle_signal(int sig)
@@ -86,6 +232,35 @@ void handle_signal(int sig)
     }
 }
 
+/* Updates the title of the window (with the mouse capture state
+ * and the speed of the simulation).
+ */
+static
+void gui_update_title(struct gui *ui)
+{
+    struct gui_internal *iui;
+    char title[TITLE_SIZE];
+    char speed[16];
+    const char *base;
+
+    iui = (struct gui_internal *) ui->internal;
+    if (iui->mouse_captured) {
+        base = "PALOS - Mouse captured. Press 'Alt' to release.";
+    } else {
+        base = "PALOS";
+    }
+
+    iui->title_speed = gui_get_speed(ui);
+    if (iui->title_speed == GUI_SPEED_REALTIME) {
+        SDL_SetWindowTitle(iui->window, base);
+        return;
+    }
+
+    gui_format_speed(iui->title_speed, speed, sizeof(speed));
+    snprintf(title, sizeof(title), "%s (%s)", base, speed);
+    SDL_SetWindowTitle(iui->window, title);
+}
+
 /* To capture the mouse movements (and keyboard).
  * The `capture` indicates whether we should capture or release
  * the mouse movements.
@@ -99,15 +274,32 @@ void gui_capture_mouse(struct gui *ui, int capture)
     if (capture) {
         SDL_ShowCursor(0);
         SDL_SetWindowGrab(iui->window, SDL_TRUE);
-        SDL_SetWindowTitle(iui->window,
-                           "PALOS - Mouse captured. Press 'Alt' to release.");
     } else {
         SDL_ShowCursor(1);
         SDL_SetWindowGrab(iui->window, SDL_FALSE);
-        SDL_SetWindowTitle(iui->window, "PALOS");
     }
 
     iui->mouse_captured = capture;
+    gui_update_title(ui);
+}
+
+/* Switches to the next speed of the simulation (for the hotkey):
+ * realtime, 2x, 4x, up to HOTKEY_MAX_SPEED, and then max.
+ */
+static
+void gui_next_speed(struct gui *ui)
+{
+    unsigned int speed;
+
+    speed = gui_get_speed(ui);
+    if (speed == GUI_SPEED_MAX) {
+        speed = GUI_SPEED_REALTIME;
+    } else if (2 * speed > HOTKEY_MAX_SPEED) {
+        speed = GUI_SPEED_MAX;
+    } else {
+        speed *= 2;
+    }
+    gui_set_speed(ui, speed);
 }
 
 /* Processes one SDL event. */
@@ -120,7 +312,6 @@ void gui_process_event(struct gui *ui, SDL_Event *e)
     int mx, my;
 
     iui = (struct gui_internal *) ui->internal;
-    if (SDL_LockMutex(iui->mutex) != 0) return;
 
     mx = DISPLAY_WIDTH / 2;
     my = DISPLAY_HEIGHT / 2;
@@ -243,7 +434,7 @@ void gui_process_event(struct gui *ui, SDL_Event *e)
         break;
     }
 
-    SDL_UnlockMutex(iui->mutex);
+    iui->input_changed = TRUE;
 }
 
 /* Processes the SDL events.
@@ -253,6 +444,7 @@ static
 int gui_process_events(struct gui *ui)
 {
     struct gui_internal *iui;
+    struct gui_input *input;
     SDL_Event e;
     int mx, my;
 
@@ -261,7 +453,6 @@ int gui_process_events(struct gui *ui)
     mx = DISPLAY_WIDTH / 2;
     my = DISPLAY_HEIGHT / 2;
 
-    mouse_clear_movement(&iui->mous);
     while (SDL_PollEvent(&e)) {
         switch (e.type) {
         case SDL_QUIT:
@@ -303,6 +494,11 @@ int gui_process_events(struct gui *ui)
             break;
 
         case SDL_KEYDOWN:
+            /* The hotkey works even if the mouse is not captured. */
+            if (e.key.keysym.sym == SDLK_F11) {
+                gui_next_speed(ui);
+                break;
+            }
             if (!iui->mouse_captured)
                 break;
 
@@ -322,45 +518,111 @@ int gui_process_events(struct gui *ui)
         }
     }
 
+    if (iui->input_changed) {
+        /* Hand a snapshot of the input to the simulation thread. */
+        input = &iui->inputs[iui->input_back];
+        input->keyb = iui->keyb;
+        input->mous = iui->mous;
+        buffer_publish(&iui->input_state, &iui->input_back);
+        iui->input_changed = FALSE;
+
+        /* Wake up the simulation if it is sleeping. */
+        if (unlikely(!gui_wakeup(ui))) return FALSE;
+    }
+
+    /* The speed can also be changed by the debugger. */
+    if (iui->title_speed != gui_get_speed(ui))
+        gui_update_title(ui);
+
     return TRUE;
 }
 
-/* Updates the gui state and screen.
+/* Uploads the lines `y` to `y + n - 1` of the frame `frame`
+ * to the texture.
  * Returns TRUE on success.
  */
 static
-int gui_update_screen(struct gui *ui)
+int gui_upload_lines(struct gui_internal *iui,
+                     const struct gui_frame *frame, int y, int n)
 {
-    struct gui_internal *iui;
+    SDL_Rect rect;
+    uint8_t row[DISPLAY_STRIDE];
+    uint8_t *pixels8;
     void *pixels;
     int i, stride, ret;
 
-    iui = (struct gui_internal *) ui->internal;
-    ret = SDL_LockTexture(iui->texture, NULL, &pixels, &stride);
+    rect.x = 0;
+    rect.y = y;
+    rect.w = DISPLAY_WIDTH;
+    rect.h = n;
+
+    ret = SDL_LockTexture(iui->texture, &rect, &pixels, &stride);
     if (unlikely(ret < 0)) {
-        report_error("gui: update_screen: "
+        report_error("gui: upload_lines: "
                      "could not lock texture (SDL_Error(%d): %s)",
                      ret, SDL_GetError());
+        return FALSE;
     }
 
-    if (SDL_LockMutex(iui->mutex) == 0) {
-        uint8_t *pixels8;
-        pixels8 = (uint8_t *) pixels;
-        for (i = 0; i < DISPLAY_HEIGHT; i++) {
-            memcpy(&pixels8[stride * i],
-                   &iui->display_data[DISPLAY_STRIDE * i],
-                   DISPLAY_WIDTH * sizeof(uint8_t));
+    pixels8 = (uint8_t *) pixels;
+    for (i = 0; i < n; i++) {
+        display_render_line(&frame->lines[y + i], row);
+        memcpy(&pixels8[stride * i], row, DISPLAY_WIDTH * sizeof(uint8_t));
+    }
+
+    SDL_UnlockTexture(iui->texture);
+    return TRUE;
+}
+
+/* Updates the gui state and screen.
+ * Returns TRUE on success.
+ */
+static
+int gui_update_screen(struct gui *ui)
+{
+    struct gui_internal *iui;
+    const struct gui_frame *frame;
+    unsigned int i;
+    int y, n, ret;
+
+    iui = (struct gui_internal *) ui->internal;
+
+    /* Take the newest frame (if any). */
+    if (buffer_take(&iui->frame_state, &iui->frame_front)) {
+        frame = &iui->frames[iui->frame_front];
+        for (i = 0; i < DISPLAY_DIRTY_WORDS; i++)
+            iui->dirty[i] |= frame->changed[i];
+    }
+    frame = &iui->frames[iui->frame_front];
+
+    /* Only upload the runs of lines that changed. */
+    for (y = 0; y < DISPLAY_HEIGHT; y += n) {
+        if (!iui->dirty[y >> 5]) {
+            n = 32 - (y & 31);
+            continue;
+        }
+        if (!DISPLAY_IS_DIRTY(iui->dirty, y)) {
+            n = 1;
+            continue;
         }
 
-        /* Signal the condition for a new frame. */
-        SDL_CondSignal(iui->frame_cond);
+        n = 1;
+        while (y + n < DISPLAY_HEIGHT
+               && DISPLAY_IS_DIRTY(iui->dirty, y + n))
+            n++;
 
-        SDL_UnlockMutex(iui->mutex);
-    } else {
-        memset(pixels, -1, ((size_t) stride) * DISPLAY_HEIGHT);
+        /* Try again with the next frame. */
+        if (unlikely(!gui_upload_lines(iui, frame, y, n)))
+            break;
     }
+    if (y >= DISPLAY_HEIGHT)
+        memset(iui->dirty, 0, sizeof(iui->dirty));
 
-    SDL_UnlockTexture(iui->texture);
+    /* Wake up the simulation waiting for the next frame. */
+    if (SDL_LockMutex(iui->mutex) == 0) {
+        SDL_CondSignal(iui->wake_cond);
+        SDL_UnlockMutex(iui->mutex);
+    }
 
     ret = SDL_RenderCopy(iui->renderer, iui->texture,
                          NULL, NULL);
@@ -388,6 +650,34 @@ int other_thread_main(void *arg)
     return 0;
 }
 
+/* Runs the simulation without a user interface (in the headless mode).
+ * The thread callback is run in the calling thread.
+ * Returns TRUE on success.
+ */
+static
+int gui_run_headless(struct gui *ui)
+{
+    struct gui_internal *iui;
+    int ret;
+
+    iui = (struct gui_internal *) ui->internal;
+    iui->running = TRUE;
+    iui->stop_sim = FALSE;
+
+    ret = TRUE;
+    if (ui->thread_cb) {
+        if (unlikely(!(*ui->thread_cb)(ui)))
+            ret = FALSE;
+    }
+
+    if (unlikely(!gui_stop(ui))) {
+        report_error("gui: internal: run_headless: "
+                     "could not stop");
+        ret = FALSE;
+    }
+    return ret;
+}
+
 /* Runs the user interface. */
 static
 int gui_run(struct gui *ui)
@@ -453,6 +743,8 @@ int gui_run(struct gui *ui)
     iui->stop_sim = FALSE;
     iui->mouse_captured = FALSE;
     iui->skip_next_mouse_move = FALSE;
+    iui->pace_frequency = 0;
+    gui_update_title(ui);
 
     thread = SDL_CreateThread(&other_thread_main,
                               "gui_extra_thread", ui);
@@ -538,6 +830,7 @@ void gui_initvar(struct gui *ui)
 void gui_destroy(struct gui *ui)
 {
     struct gui_internal *iui;
+    unsigned int i;
     int initialized;
 
     iui = (struct gui_internal *) ui->internal;
@@ -565,18 +858,26 @@ void gui_destroy(struct gui *ui)
     }
     iui->mutex = NULL;
 
-    if (iui->frame_cond) {
-        SDL_DestroyCond(iui->frame_cond);
+    if (iui->wake_cond) {
+        SDL_DestroyCond(iui->wake_cond);
+    }
+    iui->wake_cond = NULL;
+
+    if (iui->lines) {
+        free((void *) iui->lines);
     }
-    iui->frame_cond = NULL;
+    iui->lines = NULL;
 
-    if (iui->display_data) {
-        free((void *) iui->display_data);
+    for (i = 0; i < NUM_BUFFERS; i++) {
+        if (iui->frames[i].lines) {
+            free((void *) iui->frames[i].lines);
+        }
+        iui->frames[i].lines = NULL;
     }
-    iui->display_data = NULL;
 
     keyboard_destroy(&iui->keyb);
     mouse_destroy(&iui->mous);
+    script_destroy(&iui->scr);
 
     /* Unchain the objects. */
     if (iui->prev)
@@ -605,10 +906,11 @@ void gui_destroy(struct gui *ui)
     }
 }
 
-int gui_create(struct gui *ui, struct simulator *sim,
+int gui_create(struct gui *ui, struct simulator *sim, int headless,
                gui_thread_cb thread_cb, void *arg)
 {
     struct gui_internal *iui;
+    unsigned int i;
     int ret;
 
     gui_initvar(ui);
@@ -621,11 +923,20 @@ int gui_create(struct gui *ui, struct simulator *sim,
     }
 
     iui->initialized = FALSE;
-    iui->display_data = NULL;
+    iui->headless = headless;
+    iui->use_script = FALSE;
+    script_initvar(&iui->scr);
+    iui->lines = NULL;
+    for (i = 0; i < NUM_BUFFERS; i++) {
+        iui->frames[i].lines = NULL;
+        keyboard_initvar(&iui->inputs[i].keyb);
+        mouse_initvar(&iui->inputs[i].mous);
+    }
     keyboard_initvar(&iui->keyb);
     mouse_initvar(&iui->mous);
     iui->mutex = NULL;
-    iui->frame_cond = NULL;
+    iui->wake_cond = NULL;
+    iui->wakeup = FALSE;
     iui->window = NULL;
     iui->renderer = NULL;
     iui->texture = NULL;
@@ -633,15 +944,50 @@ int gui_create(struct gui *ui, struct simulator *sim,
     iui->prev = NULL;
 
     ui->internal = iui;
-    iui->display_data = (uint8_t *)
-        malloc(DISPLAY_DATA_SIZE * sizeof(uint8_t));
+    iui->lines = (struct display_line *)
+        malloc(DISPLAY_HEIGHT * sizeof(struct display_line));
 
-    if (unlikely(!iui->display_data)) {
+    if (unlikely(!iui->lines)) {
         report_error("gui: create: "
                      "memory exhausted");
         gui_destroy(ui);
         return FALSE;
     }
+    memset(iui->lines, 0, DISPLAY_HEIGHT * sizeof(struct display_line));
+
+    /* No frames are handed over in the headless mode. */
+    for (i = 0; i < NUM_BUFFERS && !headless; i++) {
+        iui->frames[i].lines = (struct display_line *)
+            malloc(DISPLAY_HEIGHT * sizeof(struct display_line));
+
+        if (unlikely(!iui->frames[i].lines)) {
+            report_error("gui: create: "
+                         "memory exhausted");
+            gui_destroy(ui);
+            return FALSE;
+        }
+        memset(iui->frames[i].lines, 0,
+               DISPLAY_HEIGHT * sizeof(struct display_line));
+        memset(iui->frames[i].changed, 0, sizeof(iui->frames[i].changed));
+        memset(iui->frames[i].stale, 0, sizeof(iui->frames[i].stale));
+    }
+
+    /* The texture starts uninitialized. */
+    SDL_AtomicSet(&iui->frame_state, 2);
+    iui->frame_back = 0;
+    iui->frame_front = 1;
+    memset(iui->new_dirty, 0, sizeof(iui->new_dirty));
+    memset(iui->unseen, 0xFF, sizeof(iui->unseen));
+    memset(iui->dirty, 0xFF, sizeof(iui->dirty));
+    iui->frame_counter = 0;
+
+    SDL_AtomicSet(&iui->speed, (headless) ? GUI_SPEED_MAX
+                                          : GUI_SPEED_REALTIME);
+    iui->pace_speed = GUI_SPEED_REALTIME;
+    iui->pace_frequency = 0;
+    iui->pace_cycle = 0;
+    iui->pace_counter = 0;
+    iui->title_speed = GUI_SPEED_REALTIME;
 
     if (unlikely(!keyboard_create(&iui->keyb))) {
         report_error("gui: create: "
@@ -657,35 +1003,49 @@ int gui_create(struct gui *ui, struct simulator *sim,
         return FALSE;
     }
 
+    for (i = 0; i < NUM_BUFFERS; i++) {
+        iui->inputs[i].keyb = iui->keyb;
+        iui->inputs[i].mous = iui->mous;
+    }
+    SDL_AtomicSet(&iui->input_state, 2);
+    iui->input_back = 0;
+    iui->input_front = 1;
+    iui->input_changed = FALSE;
+    iui->seen_dx = iui->seen_dy = 0;
+
     ui->sim = sim;
     ui->thread_cb = thread_cb;
     ui->arg = arg;
 
-    if (gui_ref_count == 0) {
-        /* Initialize the SDL when it is the first object created. */
-        ret = SDL_Init(SDL_INIT_VIDEO);
-        if (unlikely(ret < 0)) {
+    /* The video subsystem is not needed in the headless mode. */
+    if (!headless) {
+        if (gui_ref_count == 0) {
+            /* Initialize the SDL when it is the first object created. */
+            ret = SDL_Init(SDL_INIT_VIDEO);
+            if (unlikely(ret < 0)) {
+                report_error("gui: create: "
+                             "could not initialize SDL "
+                             "(SDL_Error(%d): %s)",
+                             ret, SDL_GetError());
+                gui_destroy(ui);
+                return FALSE;
+            }
+        }
+
+        iui->initialized = TRUE;
+        gui_ref_count++;
+
+        ret = SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
+        if (unlikely(ret == SDL_FALSE)) {
             report_error("gui: create: "
-                         "could not initialize SDL (SDL_Error(%d): %s)",
+                         "could not set render scale quality "
+                         "(SDL_Error(%d): %s)",
                          ret, SDL_GetError());
             gui_destroy(ui);
             return FALSE;
         }
     }
 
-    iui->initialized = TRUE;
-    gui_ref_count++;
-
-    ret = SDL_SetHint(SDL_HINT_RENDER_SCALE_QUALITY, "1");
-    if (unlikely(ret == SDL_FALSE)) {
-        report_error("gui: create: "
-                     "could not set render scale quality "
-                     "(SDL_Error(%d): %s)",
-                     ret, SDL_GetError());
-        gui_destroy(ui);
-        return FALSE;
-    }
-
     iui->mutex = SDL_CreateMutex();
     if (unlikely(!iui->mutex)) {
         report_error("gui: create: "
@@ -695,8 +1055,8 @@ int gui_create(struct gui *ui, struct simulator *sim,
         return FALSE;
     }
 
-    iui->frame_cond = SDL_CreateCond();
-    if (unlikely(!iui->frame_cond)) {
+    iui->wake_cond = SDL_CreateCond();
+    if (unlikely(!iui->wake_cond)) {
         report_error("gui: create: "
                      "could not create condition (SDL_Error: %s)",
                      SDL_GetError());
@@ -718,6 +1078,27 @@ int gui_create(struct gui *ui, struct simulator *sim,
     return TRUE;
 }
 
+int gui_set_script(struct gui *ui, const char *filename)
+{
+    struct gui_internal *iui;
+
+    iui = (struct gui_internal *) ui->internal;
+    if (unlikely(!iui->headless)) {
+        report_error("gui: set_script: only in the headless mode");
+        return FALSE;
+    }
+
+    script_destroy(&iui->scr);
+    iui->use_script = FALSE;
+    if (unlikely(!script_create(&iui->scr, filename))) {
+        report_error("gui: set_script: could not create script");
+        return FALSE;
+    }
+
+    iui->use_script = TRUE;
+    return TRUE;
+}
+
 int gui_start(struct gui *ui)
 {
     struct gui_internal *iui;
@@ -728,6 +1109,14 @@ int gui_start(struct gui *ui)
         return FALSE;
     }
 
+    if (iui->headless) {
+        if (unlikely(!gui_run_headless(ui))) {
+            report_error("gui: start: could not run headless");
+            return FALSE;
+        }
+        return TRUE;
+    }
+
     if (unlikely(!gui_run(ui))) {
         report_error("gui: start: could not start");
         return FALSE;
@@ -750,6 +1139,7 @@ int gui_stop(struct gui *ui)
     }
 
     iui->running = FALSE;
+    SDL_CondSignal(iui->wake_cond);
     SDL_UnlockMutex(iui->mutex);
     return TRUE;
 }
@@ -778,7 +1168,14 @@ int gui_running(struct gui *ui, int *running, int *stop_sim)
 int gui_update(struct gui *ui)
 {
     struct gui_internal *iui;
-    int ret;
+    struct gui_frame *frame;
+    struct gui_input *input;
+    const struct keyboard *keyb;
+    const struct mouse *mous;
+    struct mouse moved;
+    uint64_t now;
+    unsigned int i;
+    int y, ret;
 
     if (unlikely(!ui->sim)) {
         report_error("gui: update: no simulator object");
@@ -786,26 +1183,196 @@ int gui_update(struct gui *ui)
     }
 
     iui = (struct gui_internal *) ui->internal;
-    ret = SDL_LockMutex(iui->mutex);
-    if (unlikely(ret != 0)) {
-        report_error("gui: update: could no acquire lock "
-                     "(SDLError(%d): %s)", ret, SDL_GetError());
-        return FALSE;
+
+    if (iui->headless) {
+        /* The input only comes from the script, and the display is
+         * only read when the script asks for it.
+         */
+        if (!iui->use_script) return TRUE;
+
+        if (unlikely(!script_step(&iui->scr, ui->sim))) {
+            report_error("gui: update: could not run script");
+            return FALSE;
+        }
+        if (iui->scr.quit) return gui_stop(ui);
+        return TRUE;
+    }
+
+    /* Take the newest input snapshot (if any). The simulator only
+     * gets the mouse movement since the last snapshot taken.
+     */
+    keyb = NULL;
+    mous = NULL;
+    if (buffer_take(&iui->input_state, &iui->input_front)) {
+        input = &iui->inputs[iui->input_front];
+        moved = input->mous;
+        moved.dx = (int16_t) (input->mous.dx - iui->seen_dx);
+        moved.dy = (int16_t) (input->mous.dy - iui->seen_dy);
+        iui->seen_dx = input->mous.dx;
+        iui->seen_dy = input->mous.dy;
+
+        keyb = &input->keyb;
+        mous = &moved;
+    }
+
+    /* Faster than real time, the display is only sampled at the frame
+     * rate of the host (the changed lines keep accumulating in the
+     * display controller until then).
+     */
+    if (SDL_AtomicGet(&iui->speed) != GUI_SPEED_REALTIME) {
+        now = SDL_GetPerformanceCounter();
+        if (now - iui->frame_counter
+            < SDL_GetPerformanceFrequency() / FRAME_RATE) {
+            ret = simulator_update(ui->sim, keyb, mous, NULL, NULL);
+            if (unlikely(!ret)) {
+                report_error("gui: update: could not update state");
+                return FALSE;
+            }
+            return TRUE;
+        }
+        iui->frame_counter = now;
     }
 
-    ret = simulator_update(ui->sim, &iui->keyb, &iui->mous,
-                           iui->display_data);
+    ret = simulator_update(ui->sim, keyb, mous,
+                           iui->lines, iui->new_dirty);
     if (unlikely(!ret)) {
         report_error("gui: update: could not update state");
-        SDL_UnlockMutex(iui->mutex);
         return FALSE;
     }
 
-    SDL_UnlockMutex(iui->mutex);
+    /* Bring the back frame up to date. */
+    for (i = 0; i < NUM_BUFFERS; i++) {
+        for (y = 0; y < DISPLAY_DIRTY_WORDS; y++)
+            iui->frames[i].stale[y] |= iui->new_dirty[y];
+    }
+
+    frame = &iui->frames[iui->frame_back];
+    for (y = 0; y < DISPLAY_HEIGHT; y++) {
+        if (!frame->stale[y >> 5]) {
+            y |= 31;
+            continue;
+        }
+        if (DISPLAY_IS_DIRTY(frame->stale, y))
+            frame->lines[y] = iui->lines[y];
+    }
+    memset(frame->stale, 0, sizeof(frame->stale));
+
+    for (y = 0; y < DISPLAY_DIRTY_WORDS; y++)
+        frame->changed[y] = iui->unseen[y] | iui->new_dirty[y];
+
+    /* When the previous frame was dropped (never taken by the gui
+     * thread), its changes must be carried over to the next frames.
+     */
+    if (buffer_publish(&iui->frame_state, &iui->frame_back)) {
+        memcpy(iui->unseen, frame->changed, sizeof(iui->unseen));
+    } else {
+        memcpy(iui->unseen, iui->new_dirty, sizeof(iui->unseen));
+    }
+    memset(iui->new_dirty, 0, sizeof(iui->new_dirty));
     return TRUE;
 }
 
-int gui_wait_frame(struct gui *ui)
+int gui_wait_frame(struct gui *ui, int64_t cycle, int64_t frequency)
+{
+    struct gui_internal *iui;
+    unsigned int speed;
+    uint64_t now, host_freq, target;
+    int64_t elapsed, rate, delta;
+
+    iui = (struct gui_internal *) ui->internal;
+
+    speed = gui_get_speed(ui);
+    if (speed == GUI_SPEED_MAX) {
+        iui->pace_frequency = 0;
+        return TRUE;
+    }
+
+    now = SDL_GetPerformanceCounter();
+    if (iui->pace_frequency != frequency || iui->pace_speed != speed
+        || cycle < iui->pace_cycle) {
+        iui->pace_speed = speed;
+        iui->pace_frequency = frequency;
+        iui->pace_cycle = cycle;
+        iui->pace_counter = now;
+        return TRUE;
+    }
+
+    /* The host time when the simulated time is reached (split in
+     * whole seconds and the remainder, to avoid overflows).
+     */
+    host_freq = SDL_GetPerformanceFrequency();
+    elapsed = cycle - iui->pace_cycle;
+    rate = frequency * (int64_t) speed;
+    target = iui->pace_counter
+        + ((uint64_t) (elapsed / rate)) * host_freq
+        + ((uint64_t) (elapsed % rate)) * host_freq / ((uint64_t) rate);
+    delta = (int64_t) (target - now);
+
+    if (delta > 0) {
+        SDL_Delay((uint32_t) ((delta * 1000 + host_freq - 1) / host_freq));
+    } else if (-delta > (int64_t) (host_freq * MAX_FRAME_LAG_MS / 1000)) {
+        /* Too far behind (for example, the simulation was stopped, or
+         * the host is not fast enough), so do not try to catch up.
+         */
+        iui->pace_cycle = cycle;
+        iui->pace_counter = now;
+    }
+    return TRUE;
+}
+
+void gui_set_speed(struct gui *ui, unsigned int speed)
+{
+    struct gui_internal *iui;
+
+    iui = (struct gui_internal *) ui->internal;
+    if (speed > GUI_MAX_SPEED) speed = GUI_MAX_SPEED;
+    SDL_AtomicSet(&iui->speed, (int) speed);
+}
+
+unsigned int gui_get_speed(struct gui *ui)
+{
+    struct gui_internal *iui;
+
+    iui = (struct gui_internal *) ui->internal;
+    return (unsigned int) SDL_AtomicGet(&iui->speed);
+}
+
+int gui_parse_speed(const char *str, unsigned int *speed)
+{
+    unsigned long val;
+    char *end;
+
+    if (strcmp(str, "realtime") == 0) {
+        *speed = GUI_SPEED_REALTIME;
+        return TRUE;
+    }
+
+    if (strcmp(str, "max") == 0) {
+        *speed = GUI_SPEED_MAX;
+        return TRUE;
+    }
+
+    val = strtoul(str, &end, 10);
+    if (end != str && end[0] == 'x') end++;
+    if (end == str || end[0] != '\0' || val == 0 || val > GUI_MAX_SPEED)
+        return FALSE;
+
+    *speed = (unsigned int) val;
+    return TRUE;
+}
+
+void gui_format_speed(unsigned int speed, char *buf, size_t size)
+{
+    if (speed == GUI_SPEED_MAX) {
+        snprintf(buf, size, "max");
+    } else if (speed == GUI_SPEED_REALTIME) {
+        snprintf(buf, size, "realtime");
+    } else {
+        snprintf(buf, size, "%ux", speed);
+    }
+}
+
+int gui_wakeup(struct gui *ui)
 {
     struct gui_internal *iui;
     int ret;
@@ -813,19 +1380,56 @@ int gui_wait_frame(struct gui *ui)
     iui = (struct gui_internal *) ui->internal;
     ret = SDL_LockMutex(iui->mutex);
     if (unlikely(ret != 0)) {
-        report_error("gui: wait_next_frame: could no acquire lock "
+        report_error("gui: wakeup: could no acquire lock "
                      "(SDLError(%d): %s)", ret, SDL_GetError());
         return FALSE;
     }
 
-    ret = SDL_CondWait(iui->frame_cond, iui->mutex);
+    iui->wakeup = TRUE;
+    SDL_CondSignal(iui->wake_cond);
+    SDL_UnlockMutex(iui->mutex);
+    return TRUE;
+}
+
+int gui_wait_wakeup(struct gui *ui, int *woken)
+{
+    struct gui_internal *iui;
+    int ret;
+
+    iui = (struct gui_internal *) ui->internal;
+    ret = SDL_LockMutex(iui->mutex);
     if (unlikely(ret != 0)) {
-        report_error("gui: wait_next_frame: could wait condition "
+        report_error("gui: wait_wakeup: could no acquire lock "
                      "(SDLError(%d): %s)", ret, SDL_GetError());
-        SDL_UnlockMutex(iui->mutex);
         return FALSE;
     }
 
+    if (iui->headless && iui->use_script
+        && !script_finished(&iui->scr)) {
+        /* The script still has to run. */
+        iui->wakeup = TRUE;
+    }
+
+    if (!iui->wakeup && iui->running) {
+        /* There are no frames to wake up the simulation in the
+         * headless mode, so it wakes up by itself.
+         */
+        if (iui->headless) {
+            ret = SDL_CondWaitTimeout(iui->wake_cond, iui->mutex,
+                                      1000 / FRAME_RATE);
+        } else {
+            ret = SDL_CondWait(iui->wake_cond, iui->mutex);
+        }
+        if (unlikely(ret < 0)) {
+            report_error("gui: wait_wakeup: could wait condition "
+                         "(SDLError(%d): %s)", ret, SDL_GetError());
+            SDL_UnlockMutex(iui->mutex);
+            return FALSE;
+        }
+    }
+
+    *woken = iui->wakeup;
+    iui->wakeup = FALSE;
     SDL_UnlockMutex(iui->mutex);
     return TRUE;
 }
@@ -2,8 +2,16 @@
 #ifndef __GUI_GUI_H
 #define __GUI_GUI_H
 
+#include <stddef.h>
+#include <stdint.h>
+
 #include "simulator/simulator.h"
 
+/* Constants. */
+#define GUI_SPEED_MAX                      0  /* Run as fast as possible. */
+#define GUI_SPEED_REALTIME                 1
+#define GUI_MAX_SPEED                     64  /* Largest multiplier. */
+
 /* Data structures and types. */
 
 /* Callback to run as a separate thread in gui_start(). */
@@ -37,14 +45,24 @@ void gui_destroy(struct gui *ui);
 /* Creates a new gui object.
  * This obeys the initvar / destroy / create protocol.
  * The parameter `sim` is a reference to the simulator.
- * The parameter `thread_cb` is a callback to be run in a separate thread,
- * and the argument `arg` is an extra argument to be used by this thread
- * (via ui->arg). If `thread_cb` is NULL, no separate thread is created.
+ * The parameter `headless` tells whether to run without a user interface
+ * (no window is created, the display is not drawn and the speed starts
+ * as GUI_SPEED_MAX).
+ * The parameter `thread_cb` is a callback to be run in a separate thread
+ * (or in the calling thread in the headless mode), and the argument
+ * `arg` is an extra argument to be used by this thread (via ui->arg).
+ * If `thread_cb` is NULL, no separate thread is created.
  * Returns TRUE on success.
  */
-int gui_create(struct gui *ui, struct simulator *sim,
+int gui_create(struct gui *ui, struct simulator *sim, int headless,
                gui_thread_cb thread_cb, void *arg);
 
+/* Reads the input for the simulation from a script (see gui/script.h)
+ * named `filename`. This is only available in the headless mode.
+ * Returns TRUE on success.
+ */
+int gui_set_script(struct gui *ui, const char *filename);
+
 /* Starts the user interface.
  * Returns TRUE on success.
  */
@@ -64,15 +82,56 @@ int gui_stop(struct gui *ui);
  */
 int gui_running(struct gui *ui, int *running, int *stop_sim);
 
-/* Updates the user interface.
+/* Updates the user interface: passes the newest input to the simulator
+ * and hands the current display over to the gui thread (without
+ * waiting for it).
  * Returns TRUE on success.
  */
 int gui_update(struct gui *ui);
 
-/* Waits until the next frame is drawn.
+/* Paces the simulation according to the speed (see gui_set_speed()).
+ * It waits until the host clock reaches the simulated time, which is
+ * given by the cycle count `cycle` of a cpu running at `frequency`
+ * hertz. It does not wait for the frames to be drawn by the gui thread.
+ * Returns TRUE on success.
+ */
+int gui_wait_frame(struct gui *ui, int64_t cycle, int64_t frequency);
+
+/* Sets the speed of the simulation, as a multiple of the real time
+ * (from GUI_SPEED_REALTIME to GUI_MAX_SPEED), or GUI_SPEED_MAX to never
+ * wait (the display is still presented at 60 frames per second).
+ * This is thread-safe (the speed can also be changed with F11).
+ */
+void gui_set_speed(struct gui *ui, unsigned int speed);
+
+/* Obtains the speed of the simulation (see gui_set_speed()). */
+unsigned int gui_get_speed(struct gui *ui);
+
+/* Parses the speed in `str`: "realtime", "max" or a multiplier such
+ * as "4x" (or just "4"). The result is returned in `speed`.
+ * Returns TRUE on success.
+ */
+int gui_parse_speed(const char *str, unsigned int *speed);
+
+/* Formats the speed `speed` as parsed by gui_parse_speed() into `buf`
+ * (of `size` bytes).
+ */
+void gui_format_speed(unsigned int speed, char *buf, size_t size);
+
+/* Wakes up the simulation thread sleeping in gui_wait_wakeup().
+ * This is thread-safe, and can be called, for example, when a network
+ * packet arrives.
+ * Returns TRUE on success.
+ */
+int gui_wakeup(struct gui *ui);
+
+/* Sleeps until there is new input (or a call to gui_wakeup()), or
+ * until the next frame is drawn, whichever comes first.
+ * The parameter `woken` returns TRUE if new input arrived since the
+ * last call to this function (the pending input is then cleared).
  * Returns TRUE on success.
  */
-int gui_wait_frame(struct gui *ui);
+int gui_wait_wakeup(struct gui *ui, int *woken);
 
 
 #endif /* __GUI_GUI_H */
@@ -0,0 +1,407 @@
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+
+#include "gui/script.h"
+#include "simulator/display.h"
+#include "simulator/keyboard.h"
+#include "simulator/mouse.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define TYPE_FIELDS                        2  /* Fields to hold each key
+                                               * (and to release it) when
+                                               * typing a text.
+                                               */
+
+/* Data structures and types. */
+
+/* The names of the keys and buttons used in the script. */
+struct key_name {
+    const char *name;             /* The name. */
+    enum alto_key key;            /* The key (or AK_NONE). */
+    enum alto_button btn;         /* The button (or AB_NONE). */
+};
+
+/* Global variables. */
+static const struct key_name key_names[] = {
+    { "space", AK_SPACE, AB_NONE },
+    { "plus", AK_PLUS, AB_NONE },
+    { "minus", AK_MINUS, AB_NONE },
+    { "comma", AK_COMMA, AB_NONE },
+    { "period", AK_PERIOD, AB_NONE },
+    { "semicolon", AK_SEMICOLON, AB_NONE },
+    { "quote", AK_QUOTE, AB_NONE },
+    { "lbracket", AK_LBRACKET, AB_NONE },
+    { "rbracket", AK_RBRACKET, AB_NONE },
+    { "fslash", AK_FSLASH, AB_NONE },
+    { "bslash", AK_BSLASH, AB_NONE },
+    { "arrow", AK_ARROW, AB_NONE },
+    { "lock", AK_LOCK, AB_NONE },
+    { "lshift", AK_LSHIFT, AB_NONE },
+    { "rshift", AK_RSHIFT, AB_NONE },
+    { "lf", AK_LF, AB_NONE },
+    { "bs", AK_BS, AB_NONE },
+    { "del", AK_DEL, AB_NONE },
+    { "esc", AK_ESC, AB_NONE },
+    { "tab", AK_TAB, AB_NONE },
+    { "ctrl", AK_CTRL, AB_NONE },
+    { "return", AK_RETURN, AB_NONE },
+    { "blanktop", AK_BLANKTOP, AB_NONE },
+    { "blankmiddle", AK_BLANKMIDDLE, AB_NONE },
+    { "blankbottom", AK_BLANKBOTTOM, AB_NONE },
+    { "left", AK_NONE, AB_BTN_LEFT },
+    { "middle", AK_NONE, AB_BTN_MIDDLE },
+    { "right", AK_NONE, AB_BTN_RIGHT },
+    { "keyset0", AK_NONE, AB_KEYSET0 },
+    { "keyset1", AK_NONE, AB_KEYSET1 },
+    { "keyset2", AK_NONE, AB_KEYSET2 },
+    { "keyset3", AK_NONE, AB_KEYSET3 },
+    { "keyset4", AK_NONE, AB_KEYSET4 },
+    { NULL, AK_NONE, AB_NONE },
+};
+
+/* Functions. */
+
+void script_initvar(struct script *scr)
+{
+    scr->fp = NULL;
+    scr->is_stdin = FALSE;
+    keyboard_initvar(&scr->keyb);
+    mouse_initvar(&scr->mous);
+}
+
+void script_destroy(struct script *scr)
+{
+    if (scr->fp && !scr->is_stdin) fclose(scr->fp);
+    scr->fp = NULL;
+
+    keyboard_destroy(&scr->keyb);
+    mouse_destroy(&scr->mous);
+}
+
+int script_create(struct script *scr, const char *filename)
+{
+    script_initvar(scr);
+
+    if (strcmp(filename, "-") == 0) {
+        scr->fp = stdin;
+        scr->is_stdin = TRUE;
+    } else {
+        scr->fp = fopen(filename, "r");
+        if (unlikely(!scr->fp)) {
+            report_error("script: create: could not open `%s`", filename);
+            script_destroy(scr);
+            return FALSE;
+        }
+    }
+
+    if (unlikely(!keyboard_create(&scr->keyb))) {
+        report_error("script: create: could not create keyboard");
+        script_destroy(scr);
+        return FALSE;
+    }
+
+    if (unlikely(!mouse_create(&scr->mous))) {
+        report_error("script: create: could not create mouse");
+        script_destroy(scr);
+        return FALSE;
+    }
+
+    scr->line_num = 0;
+    scr->eof = FALSE;
+    scr->quit = FALSE;
+    scr->wait_fields = 0;
+    scr->text[0] = '\0';
+    scr->text_pos = 0;
+    scr->text_pressed = FALSE;
+    scr->changed = FALSE;
+    return TRUE;
+}
+
+/* Obtains the key to type the character `c`.
+ * The key is returned in `key`, and `shift` tells whether the
+ * shift key must be held as well.
+ * Returns TRUE if the character can be typed.
+ */
+static
+int char_key(int c, enum alto_key *key, int *shift)
+{
+    *shift = FALSE;
+    if (c >= 'a' && c <= 'z') {
+        *key = (enum alto_key) (AK_A + (c - 'a'));
+    } else if (c >= 'A' && c <= 'Z') {
+        *key = (enum alto_key) (AK_A + (c - 'A'));
+        *shift = TRUE;
+    } else if (c >= '0' && c <= '9') {
+        *key = (enum alto_key) (AK_0 + (c - '0'));
+    } else {
+        switch (c) {
+        case ' ': *key = AK_SPACE; break;
+        case '=': *key = AK_PLUS; break;
+        case '-': *key = AK_MINUS; break;
+        case ',': *key = AK_COMMA; break;
+        case '.': *key = AK_PERIOD; break;
+        case ';': *key = AK_SEMICOLON; break;
+        case '\'': *key = AK_QUOTE; break;
+        case '[': *key = AK_LBRACKET; break;
+        case ']': *key = AK_RBRACKET; break;
+        case '/': *key = AK_FSLASH; break;
+        case '\\': *key = AK_BSLASH; break;
+        default:
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+/* Presses or releases the key named `name`.
+ * The parameter `press` tells whether to press or release it.
+ * Returns TRUE on success.
+ */
+static
+int press_key(struct script *scr, const char *name, int press)
+{
+    const struct key_name *kn;
+    enum alto_key key;
+    enum alto_button btn;
+    int shift;
+
+    key = AK_NONE;
+    btn = AB_NONE;
+    if (name[0] != '\0' && name[1] == '\0'
+        && char_key(tolower((unsigned char) name[0]), &key, &shift)) {
+        /* A single character names its own key. */
+    } else {
+        for (kn = key_names; kn->name; kn++) {
+            if (strcmp(kn->name, name) == 0) break;
+        }
+        if (unlikely(!kn->name)) {
+            report_error("script: line %u: invalid key `%s`",
+                         scr->line_num, name);
+            return FALSE;
+        }
+        key = kn->key;
+        btn = kn->btn;
+    }
+
+    if (press) {
+        keyboard_press_key(&scr->keyb, key);
+        mouse_press_button(&scr->mous, btn);
+    } else {
+        keyboard_release_key(&scr->keyb, key);
+        mouse_release_button(&scr->mous, btn);
+    }
+    scr->changed = TRUE;
+    return TRUE;
+}
+
+/* Presses or releases the next character of the text being typed.
+ * Returns TRUE on success.
+ */
+static
+int type_char(struct script *scr)
+{
+    enum alto_key key;
+    int c, shift;
+
+    c = (unsigned char) scr->text[scr->text_pos];
+    if (unlikely(!char_key(c, &key, &shift))) {
+        report_error("script: line %u: can not type `%c`",
+                     scr->line_num, c);
+        return FALSE;
+    }
+
+    if (!scr->text_pressed) {
+        if (shift) keyboard_press_key(&scr->keyb, AK_LSHIFT);
+        keyboard_press_key(&scr->keyb, key);
+        scr->text_pressed = TRUE;
+    } else {
+        keyboard_release_key(&scr->keyb, key);
+        if (shift) keyboard_release_key(&scr->keyb, AK_LSHIFT);
+        scr->text_pressed = FALSE;
+        scr->text_pos++;
+    }
+    scr->changed = TRUE;
+    return TRUE;
+}
+
+/* Writes the display of the simulator `sim` to the file named
+ * `filename` (as a binary PGM image).
+ * Returns TRUE on success.
+ */
+static
+int dump_display(struct simulator *sim, const char *filename)
+{
+    struct display_line *lines;
+    uint8_t row[DISPLAY_STRIDE];
+    unsigned int y;
+    FILE *fp;
+
+    lines = (struct display_line *)
+        malloc(DISPLAY_HEIGHT * sizeof(struct display_line));
+    if (unlikely(!lines)) {
+        report_error("script: dump_display: memory exhausted");
+        return FALSE;
+    }
+
+    if (unlikely(!simulator_update(sim, NULL, NULL, lines, NULL))) {
+        report_error("script: dump_display: could not obtain display");
+        free((void *) lines);
+        return FALSE;
+    }
+
+    fp = fopen(filename, "wb");
+    if (unlikely(!fp)) {
+        report_error("script: dump_display: could not open `%s` "
+                     "for writing", filename);
+        free((void *) lines);
+        return FALSE;
+    }
+
+    if (fprintf(fp, "P5\n%d %d\n255\n",
+                DISPLAY_WIDTH, DISPLAY_HEIGHT) < 0)
+        goto error;
+
+    for (y = 0; y < DISPLAY_HEIGHT; y++) {
+        display_render_line(&lines[y], row);
+        if (fwrite(row, sizeof(uint8_t), DISPLAY_WIDTH, fp)
+            != DISPLAY_WIDTH)
+            goto error;
+    }
+
+    fclose(fp);
+    free((void *) lines);
+    return TRUE;
+
+error:
+    report_error("script: dump_display: error while writing `%s`",
+                 filename);
+    fclose(fp);
+    free((void *) lines);
+    return FALSE;
+}
+
+/* Reads and runs the next command of the script.
+ * Returns TRUE on success.
+ */
+static
+int run_command(struct script *scr, struct simulator *sim)
+{
+    char line[SCRIPT_LINE_SIZE];
+    char *cmd, *arg, *endptr, *dy_str;
+    size_t len;
+    long dx, dy;
+    int c;
+
+    if (!fgets(line, sizeof(line), scr->fp)) {
+        scr->eof = TRUE;
+        return TRUE;
+    }
+    scr->line_num++;
+
+    /* A line without the newline is only valid at the end of the file
+     * (otherwise the rest of the line would be read as a new command).
+     */
+    len = strlen(line);
+    if (len > 0 && line[len - 1] != '\n') {
+        c = getc(scr->fp);
+        if (c != EOF) {
+            report_error("script: line %u: line too long (more than %d "
+                         "characters)", scr->line_num,
+                         SCRIPT_LINE_SIZE - 2);
+            return FALSE;
+        }
+    }
+
+    /* Split the command from its argument. */
+    while (len > 0 && isspace((unsigned char) line[len - 1]))
+        line[--len] = '\0';
+
+    cmd = line;
+    while (isspace((unsigned char) *cmd)) cmd++;
+    if (cmd[0] == '\0' || cmd[0] == '#') return TRUE;
+
+    arg = cmd;
+    while (*arg && !isspace((unsigned char) *arg)) arg++;
+    if (*arg) *arg++ = '\0';
+    while (isspace((unsigned char) *arg)) arg++;
+
+    if (strcmp(cmd, "wait") == 0) {
+        scr->wait_fields = (unsigned int) strtoul(arg, &endptr, 10);
+        if (unlikely(arg[0] == '\0' || endptr[0] != '\0')) {
+            report_error("script: line %u: invalid number of fields `%s`",
+                         scr->line_num, arg);
+            return FALSE;
+        }
+    } else if (strcmp(cmd, "press") == 0) {
+        return press_key(scr, arg, TRUE);
+    } else if (strcmp(cmd, "release") == 0) {
+        return press_key(scr, arg, FALSE);
+    } else if (strcmp(cmd, "type") == 0) {
+        strcpy(scr->text, arg);
+        scr->text_pos = 0;
+        scr->text_pressed = FALSE;
+    } else if (strcmp(cmd, "move") == 0) {
+        /* Both the X and the Y movements are required. */
+        dx = strtol(arg, &dy_str, 10);
+        dy = strtol(dy_str, &endptr, 10);
+        if (unlikely(dy_str == arg || endptr == dy_str
+                     || endptr[0] != '\0')) {
+            report_error("script: line %u: invalid movement `%s`",
+                         scr->line_num, arg);
+            return FALSE;
+        }
+        mouse_move(&scr->mous, (int16_t) dx, (int16_t) dy);
+        scr->changed = TRUE;
+    } else if (strcmp(cmd, "dump") == 0) {
+        return dump_display(sim, arg);
+    } else if (strcmp(cmd, "quit") == 0) {
+        scr->quit = TRUE;
+    } else {
+        report_error("script: line %u: invalid command `%s`",
+                     scr->line_num, cmd);
+        return FALSE;
+    }
+    return TRUE;
+}
+
+int script_step(struct script *scr, struct simulator *sim)
+{
+    while (!scr->quit) {
+        if (scr->wait_fields > 0) {
+            scr->wait_fields--;
+            break;
+        }
+
+        if (scr->text[scr->text_pos] != '\0') {
+            if (unlikely(!type_char(scr))) return FALSE;
+            scr->wait_fields = TYPE_FIELDS;
+            continue;
+        }
+
+        if (scr->eof) break;
+        if (unlikely(!run_command(scr, sim))) return FALSE;
+    }
+
+    if (scr->changed) {
+        if (unlikely(!simulator_update(sim, &scr->keyb, &scr->mous,
+                                       NULL, NULL))) {
+            report_error("script: step: could not update simulator");
+            return FALSE;
+        }
+        mouse_clear_movement(&scr->mous);
+        scr->changed = FALSE;
+    }
+    return TRUE;
+}
+
+int script_finished(const struct script *scr)
+{
+    if (scr->quit) return TRUE;
+    return (scr->eof && scr->wait_fields == 0
+            && scr->text[scr->text_pos] == '\0');
+}
@@ -0,0 +1,82 @@
+
+#ifndef __GUI_SCRIPT_H
+#define __GUI_SCRIPT_H
+
+#include <stdio.h>
+
+#include "simulator/simulator.h"
+
+/* Constants. */
+#define SCRIPT_LINE_SIZE                 256
+
+/* Data structures and types. */
+
+/* An input script, to drive the simulation without a user interface.
+ * The script is a text file with one command per line, which are run
+ * as the display fields are simulated:
+ *   wait n        Waits for `n` display fields.
+ *   press key     Presses a key (or a mouse button).
+ *   release key   Releases a key (or a mouse button).
+ *   type text     Types the text (the rest of the line).
+ *   move dx dy    Moves the mouse.
+ *   dump file     Writes the display to `file` (as a PGM image).
+ *   quit          Stops the simulation.
+ * Empty lines and lines starting with `#` are ignored.
+ */
+struct script {
+    FILE *fp;                     /* The script file. */
+    int is_stdin;                 /* If the script is read from stdin. */
+    unsigned int line_num;        /* The current line number. */
+    int eof;                      /* No more commands in the script. */
+    int quit;                     /* The script asked to quit. */
+
+    unsigned int wait_fields;     /* Display fields left to wait. */
+    char text[SCRIPT_LINE_SIZE];  /* The text being typed. */
+    unsigned int text_pos;        /* The next character to type. */
+    int text_pressed;             /* The character is being pressed. */
+
+    struct keyboard keyb;         /* The keyboard state. */
+    struct mouse mous;            /* The mouse state. */
+    int changed;                  /* The input changed since the last
+                                   * update of the simulator.
+                                   */
+};
+
+/* Functions. */
+
+/* Initializes the script variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void script_initvar(struct script *scr);
+
+/* Destroys the script object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void script_destroy(struct script *scr);
+
+/* Creates a new script object.
+ * This obeys the initvar / destroy / create protocol.
+ * The commands are read from the file named `filename` (or from the
+ * standard input if `filename` is "-", so that another process can
+ * drive the simulation through a pipe or a socket).
+ * Returns TRUE on success.
+ */
+int script_create(struct script *scr, const char *filename);
+
+/* Runs the script for one display field of the simulator `sim`.
+ * The commands are run until one of them waits, and the input state
+ * is passed to the simulator.
+ * Returns TRUE on success.
+ */
+int script_step(struct script *scr, struct simulator *sim);
+
+/* Checks if the script has finished (and the simulation can sleep
+ * while the Alto is idle).
+ * Returns TRUE if there is nothing else to run.
+ */
+int script_finished(const struct script *scr);
+
+
+#endif /* __GUI_SCRIPT_H */
@@ -213,6 +213,8 @@ int udp_transport_create(struct udp_transport *utrp)
     utrp->rx_pos = 0;
     utrp->rx_len = 0;
     utrp->rx_enable = TRUE;
+    utrp->rx_notify = NULL;
+    utrp->rx_notify_arg = NULL;
 
     iutrp->running = TRUE;
     iutrp->thread = SDL_CreateThread(&receive_thread,
@@ -239,6 +241,29 @@ int udp_transport_create(struct udp_transport *utrp)
     return TRUE;
 }
 
+int udp_transport_set_rx_notify(struct udp_transport *utrp,
+                                void (*rx_notify)(void *arg),
+                                void *arg)
+{
+    struct udp_transport_internal *iutrp;
+    int ret;
+
+    iutrp = (struct udp_transport_internal *) utrp->internal;
+    ret = SDL_LockMutex(iutrp->mutex);
+    if (unlikely(ret != 0)) {
+        report_error("udp_transport: set_rx_notify: "
+                     "could no acquire lock (SDLError(%d): %s)",
+                     ret, SDL_GetError());
+        return FALSE;
+    }
+
+    utrp->rx_notify = rx_notify;
+    utrp->rx_notify_arg = arg;
+
+    SDL_UnlockMutex(iutrp->mutex);
+    return TRUE;
+}
+
 /* To clear the TX buffer. */
 static
 void trp_clear_tx(void *arg)
@@ -482,6 +507,8 @@ int receive_thread(void *arg)
     size_t free_size;
     size_t len, packet_len;
     size_t pos, ring_pos;
+    void (*rx_notify)(void *arg);
+    void *rx_notify_arg;
     int ret, running;
     ssize_t s;
 
@@ -599,7 +626,11 @@ int receive_thread(void *arg)
             utrp->ring_end += len - pos;
         }
 
+        rx_notify = utrp->rx_notify;
+        rx_notify_arg = utrp->rx_notify_arg;
         SDL_UnlockMutex(iutrp->mutex);
+
+        if (rx_notify) (*rx_notify)(rx_notify_arg);
     }
 
     return 0;
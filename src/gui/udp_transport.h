@@ -20,6 +20,10 @@ struct udp_transport {
     size_t rx_pos;                /* Position in the UDP rx buffer. */
     size_t rx_len;                /* Length of the UDP rx buffer. */
     int rx_enable;                /* If receiving packet is enabled. */
+    void (*rx_notify)(void *arg); /* Called (from the receiving thread)
+                                   * after a packet is received.
+                                   */
+    void *rx_notify_arg;          /* Argument passed to `rx_notify`. */
 
     struct transport trp;         /* The populated transport structure. */
     void *internal;               /* Opaque internal structure. */
@@ -45,5 +49,15 @@ void udp_transport_destroy(struct udp_transport *utrp);
  */
 int udp_transport_create(struct udp_transport *utrp);
 
+/* Sets the callback invoked when a packet is received.
+ * The callback `rx_notify` is invoked (from the receiving thread) with
+ * the argument `arg` after each packet is queued. If `rx_notify` is
+ * NULL, no callback is invoked.
+ * Returns TRUE on success.
+ */
+int udp_transport_set_rx_notify(struct udp_transport *utrp,
+                                void (*rx_notify)(void *arg),
+                                void *arg);
+
 
 #endif /* __GUI_UDP_TRANSPORT_H */
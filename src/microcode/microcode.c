@@ -91,6 +91,15 @@ void decode_tagged_value(struct value_decoder *vdec, const char *tag,
     decode_value_padded(vdec, dec_type, val, 11);
 }
 
+void decode_tagged_cycle(struct value_decoder *vdec, const char *tag,
+                         int64_t cycle)
+{
+    struct string_buffer *output;
+
+    output = vdec->dec->output;
+    string_buffer_print(output, "%-9s: %-11lld", tag, (long long) cycle);
+}
+
 /* Decodes the non-data function part of the instruction. */
 static
 void decode_nondata_function(struct decoder *dec)
@@ -326,6 +326,12 @@ void decode_value_padded(struct value_decoder *vdec,
 void decode_tagged_value(struct value_decoder *vdec, const char *tag,
                          enum decode_type dec_type, uint32_t val);
 
+/* Decodes a tagged cycle count. The `tag` parameters specifies the tag
+ * name and `cycle` the (signed 64-bit) cycle count.
+ */
+void decode_tagged_cycle(struct value_decoder *vdec, const char *tag,
+                         int64_t cycle);
+
 /* Decodes the microinstruction in the decoder `dec`. */
 void decode_microcode(struct decoder *dec);
 
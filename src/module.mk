@@ -4,12 +4,13 @@ COMMON_OBJS := common/allocator.o common/table.o common/serdes.o \
 DEBUGGER_OBJS := debugger/debugger.o debugger/cmd.o
 FS_OBJS := fs/basic.o fs/check.o fs/dir.o fs/disk.o fs/file.o fs/fs.o \
  fs/meta.o fs/scan.o fs/print.o
-GUI_OBJS := gui/gui.o gui/udp_transport.o
+GUI_OBJS := gui/gui.o gui/script.o gui/udp_transport.o
 MICROCODE_OBJS := microcode/microcode.o microcode/nova.o
 PARSER_OBJS := parser/parser.o parser/lexer.o
 SIMULATOR_OBJS := simulator/simulator.o simulator/disk.o \
  simulator/display.o simulator/ethernet.o simulator/keyboard.o \
- simulator/mouse.o simulator/intr.o simulator/rom.o
+ simulator/mouse.o simulator/intr.o simulator/bitblt.o \
+ simulator/blkcache.o simulator/rom.o
 
 
 PMU_OBJS := $(ASSEMBLER_OBJS) $(COMMON_OBJS) $(PARSER_OBJS) \
@@ -59,8 +60,8 @@ par.o: par.c fs/fs.h common/utils.h
 simulator/simulator.o: simulator/simulator.c simulator/simulator.h \
  microcode/microcode.h common/string_buffer.h microcode/nova.h \
  simulator/disk.h common/serdes.h simulator/display.h simulator/ethernet.h \
- simulator/keyboard.h simulator/mouse.h simulator/intr.h simulator/rom.h \
- common/utils.h
+ simulator/keyboard.h simulator/mouse.h simulator/intr.h \
+ simulator/bitblt.h simulator/blkcache.h simulator/rom.h common/utils.h
 simulator/disk.o: simulator/disk.c simulator/disk.h microcode/microcode.h \
  common/string_buffer.h common/serdes.h simulator/intr.h common/utils.h
 simulator/display.o: simulator/display.c simulator/display.h \
@@ -76,12 +77,19 @@ simulator/mouse.o: simulator/mouse.c simulator/mouse.h \
  microcode/microcode.h common/string_buffer.h common/serdes.h \
  common/utils.h
 simulator/intr.o: simulator/intr.c simulator/intr.h common/utils.h
+simulator/bitblt.o: simulator/bitblt.c simulator/bitblt.h common/utils.h
+simulator/blkcache.o: simulator/blkcache.c simulator/blkcache.h \
+ common/utils.h
 simulator/rom.o: simulator/rom.c simulator/rom.h microcode/microcode.h \
  common/string_buffer.h
-gui/gui.o: gui/gui.c gui/gui.h simulator/simulator.h microcode/microcode.h \
- common/string_buffer.h microcode/nova.h simulator/disk.h common/serdes.h \
- simulator/display.h simulator/ethernet.h simulator/keyboard.h \
- simulator/mouse.h common/utils.h
+gui/gui.o: gui/gui.c gui/gui.h gui/script.h simulator/simulator.h \
+ microcode/microcode.h common/string_buffer.h microcode/nova.h \
+ simulator/disk.h common/serdes.h simulator/display.h simulator/ethernet.h \
+ simulator/keyboard.h simulator/mouse.h common/utils.h
+gui/script.o: gui/script.c gui/script.h simulator/simulator.h \
+ microcode/microcode.h common/string_buffer.h microcode/nova.h \
+ simulator/disk.h common/serdes.h simulator/display.h simulator/ethernet.h \
+ simulator/keyboard.h simulator/mouse.h common/utils.h
 gui/udp_transport.o: gui/udp_transport.c gui/udp_transport.h \
  simulator/ethernet.h microcode/microcode.h common/string_buffer.h \
  common/serdes.h common/utils.h
@@ -5,6 +5,7 @@
 #include <ctype.h>
 
 #include "simulator/simulator.h"
+#include "simulator/intr.h"
 #include "simulator/disk.h"
 #include "simulator/ethernet.h"
 #include "gui/gui.h"
@@ -14,6 +15,26 @@
 
 /* Data structures and types. */
 
+/* The options of the simulator and of the user interface. */
+struct palos_options {
+    enum sim_engine engine;       /* The execution engine. */
+    int idle_sleep;               /* To sleep while the Alto is idle. */
+    int native_bitblt;            /* To execute BITBLT natively. */
+    int native_nova;              /* To execute the basic nova
+                                   * instructions natively.
+                                   */
+    int native_disk;              /* To transfer the disk records
+                                   * natively.
+                                   */
+    int fast_display;             /* To use the fast display mode. */
+    int fast_disk;                /* To use the fast disk mode. */
+    unsigned int clock_mult;      /* The cpu clock multiplier. */
+    int headless;                 /* To run without a user interface. */
+    const char *script_filename;  /* The input script (or NULL). */
+    int set_speed;                /* To override the default speed. */
+    unsigned int speed;           /* The speed (if set_speed). */
+};
+
 /* Internal structure for the palos simulator. */
 struct palos {
     const char *const_filename;   /* The name of the constant rom. */
@@ -56,10 +77,37 @@ void palos_destroy(struct palos *ps)
     debugger_destroy(&ps->dbg);
 }
 
+/* Wakes up the simulation when a packet is received. */
+static
+void wakeup_gui(void *arg)
+{
+    gui_wakeup((struct gui *) arg);
+}
+
+/* Sets the default values of the options in `opts`. */
+static
+void palos_default_options(struct palos_options *opts)
+{
+    opts->engine = SIM_ENGINE_THREADED;
+    opts->idle_sleep = FALSE;
+    opts->native_bitblt = FALSE;
+    opts->native_nova = FALSE;
+    opts->native_disk = FALSE;
+    opts->fast_display = FALSE;
+    opts->fast_disk = FALSE;
+    opts->clock_mult = 1;
+    opts->headless = FALSE;
+    opts->script_filename = NULL;
+    opts->set_speed = FALSE;
+    opts->speed = GUI_SPEED_REALTIME;
+}
+
 /* Creates a new palos object.
  * This obeys the initvar / destroy / create protocol.
  * The `sys_type` variable specifies the system type.
  * The `use_debugger` specifies whether or not to use the debugger.
+ * The options of the simulator and of the user interface are given
+ * by `opts`.
  * The name of the several filenames to load related to the constant rom,
  * microcode rom, binary file, and disk images are given by the parameters:
  * `const_filename`, `mcode_filename`, `binary_filename`, `disk1_filename`,
@@ -70,6 +118,7 @@ static
 int palos_create(struct palos *ps,
                  enum system_type sys_type,
                  int use_debugger,
+                 const struct palos_options *opts,
                  const char *const_filename,
                  const char *mcode_filename,
                  const char *binary_filename,
@@ -84,14 +133,32 @@ int palos_create(struct palos *ps,
         palos_destroy(ps);
         return FALSE;
     }
-
-    if (unlikely(!gui_create(&ps->ui, &ps->sim,
+    simulator_set_engine(&ps->sim, opts->engine);
+    simulator_set_native_bitblt(&ps->sim, opts->native_bitblt);
+    simulator_set_native_nova(&ps->sim, opts->native_nova);
+    simulator_set_native_disk(&ps->sim, opts->native_disk);
+    simulator_set_fast_display(&ps->sim, opts->fast_display);
+    simulator_set_fast_disk(&ps->sim, opts->fast_disk);
+    simulator_set_clock_mult(&ps->sim, opts->clock_mult);
+
+    if (unlikely(!gui_create(&ps->ui, &ps->sim, opts->headless,
                              &debugger_debug, &ps->dbg))) {
         report_error("palos: create: could not create user interface");
         palos_destroy(ps);
         return FALSE;
     }
 
+    /* Otherwise, the default speed depends on the headless mode. */
+    if (opts->set_speed) gui_set_speed(&ps->ui, opts->speed);
+
+    if (opts->script_filename) {
+        if (unlikely(!gui_set_script(&ps->ui, opts->script_filename))) {
+            report_error("palos: create: could not set input script");
+            palos_destroy(ps);
+            return FALSE;
+        }
+    }
+
     if (unlikely(!udp_transport_create(&ps->utrp))) {
         report_error("palos: create: could not create UDP transport");
         palos_destroy(ps);
@@ -104,6 +171,14 @@ int palos_create(struct palos *ps,
         palos_destroy(ps);
         return FALSE;
     }
+    ps->dbg.idle_sleep = opts->idle_sleep;
+
+    if (unlikely(!udp_transport_set_rx_notify(&ps->utrp, &wakeup_gui,
+                                              &ps->ui))) {
+        report_error("palos: create: could not set UDP notification");
+        palos_destroy(ps);
+        return FALSE;
+    }
 
     ethernet_set_transport(&ps->sim.ether, &ps->utrp.trp);
     ethernet_set_address(&ps->sim.ether, address);
@@ -193,6 +268,17 @@ void usage(const char *prog_name)
     printf("  -ii_3kram     Set system type to Alto II (3K ram)\n");
     printf("  -e addr       Set the ethernet address\n");
     printf("  -debug        To use the debugger\n");
+    printf("  -interp       Use the interpreter engine (slower)\n");
+    printf("  -idle_sleep   Sleep while the Alto is idle\n");
+    printf("  -native_bitblt Execute the BITBLT instruction natively\n");
+    printf("  -native_nova  Execute the basic nova instructions natively\n");
+    printf("  -native_disk  Transfer the disk records natively\n");
+    printf("  -fast_display Render the display a whole scanline at a time\n");
+    printf("  -fast_disk    Seek and rotate the disk without delay\n");
+    printf("  -overclock n  Run the cpu n times faster than the devices\n");
+    printf("  -speed mode   Run at `realtime`, `max` or `Nx` speed\n");
+    printf("  -headless     Run without a user interface\n");
+    printf("  -script file  Read the input from a script (- for stdin)\n");
     printf("  --help        Print this help\n");
 }
 
@@ -204,6 +290,7 @@ int main(int argc, char **argv)
     const char *disk1_filename;
     const char *disk2_filename;
     enum system_type sys_type;
+    struct palos_options opts;
     struct palos ps;
     int i, is_last;
     uint16_t address;
@@ -218,6 +305,7 @@ int main(int argc, char **argv)
     sys_type = ALTO_II_3KRAM;
     address = 100;
     use_debugger = FALSE;
+    palos_default_options(&opts);
 
     for (i = 1; i < argc; i++) {
         is_last = (i + 1 == argc);
@@ -272,6 +360,50 @@ int main(int argc, char **argv)
             }
         } else if (strcmp("-debug", argv[i]) == 0) {
             use_debugger = TRUE;
+        } else if (strcmp("-interp", argv[i]) == 0) {
+            opts.engine = SIM_ENGINE_INTERPRETER;
+        } else if (strcmp("-idle_sleep", argv[i]) == 0) {
+            opts.idle_sleep = TRUE;
+        } else if (strcmp("-native_bitblt", argv[i]) == 0) {
+            opts.native_bitblt = TRUE;
+        } else if (strcmp("-native_nova", argv[i]) == 0) {
+            opts.native_nova = TRUE;
+        } else if (strcmp("-native_disk", argv[i]) == 0) {
+            opts.native_disk = TRUE;
+        } else if (strcmp("-fast_display", argv[i]) == 0) {
+            opts.fast_display = TRUE;
+        } else if (strcmp("-fast_disk", argv[i]) == 0) {
+            opts.fast_disk = TRUE;
+        } else if (strcmp("-overclock", argv[i]) == 0) {
+            char *endptr;
+            if (is_last) {
+                report_error("main: please specify the clock multiplier");
+                return 1;
+            }
+            opts.clock_mult = strtoul(argv[++i], &endptr, 10);
+            if (endptr[0] != '\0' || opts.clock_mult == 0
+                || opts.clock_mult > INTR_MAX_CLOCK_MULT) {
+                report_error("main: invalid clock multiplier `%s`", argv[i]);
+                return 1;
+            }
+        } else if (strcmp("-speed", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the speed");
+                return 1;
+            }
+            if (!gui_parse_speed(argv[++i], &opts.speed)) {
+                report_error("main: invalid speed `%s`", argv[i]);
+                return 1;
+            }
+            opts.set_speed = TRUE;
+        } else if (strcmp("-headless", argv[i]) == 0) {
+            opts.headless = TRUE;
+        } else if (strcmp("-script", argv[i]) == 0) {
+            if (is_last) {
+                report_error("main: please specify the script file");
+                return 1;
+            }
+            opts.script_filename = argv[++i];
         } else if (strcmp("--help", argv[i]) == 0
                    || strcmp("-h", argv[i]) == 0) {
             usage(argv[0]);
@@ -285,7 +417,19 @@ int main(int argc, char **argv)
         }
     }
 
-    if (unlikely(!palos_create(&ps, sys_type, use_debugger,
+    if (opts.script_filename && !opts.headless) {
+        report_error("main: -script requires -headless");
+        return 1;
+    }
+
+    /* Both would read their commands from the standard input. */
+    if (opts.script_filename && strcmp(opts.script_filename, "-") == 0
+        && use_debugger) {
+        report_error("main: -script - cannot be used with -debug");
+        return 1;
+    }
+
+    if (unlikely(!palos_create(&ps, sys_type, use_debugger, &opts,
                                const_filename, mcode_filename,
                                binary_filename, disk1_filename,
                                disk2_filename, address))) {
@@ -0,0 +1,267 @@
+
+#include <stdint.h>
+#include <string.h>
+
+#include "simulator/bitblt.h"
+#include "common/utils.h"
+
+/* Constants. */
+#define BITBLT_FUNCTION_MASK          0x003F
+
+/* Functions. */
+
+/* Determines if the source type uses the source bitmap. */
+#define USES_SOURCE(function) \
+    (((function) & BITBLT_SOURCE_TYPE) != BITBLT_SRC_GRAY)
+
+int bitblt_decode(struct bitblt *bb, const uint16_t *table)
+{
+    bb->function = table[0];
+    bb->dbca = table[2];
+    bb->dbmr = table[3];
+    bb->dlx = table[4];
+    bb->dty = table[5];
+    bb->dw = table[6];
+    bb->dh = table[7];
+    bb->sbca = table[8];
+    bb->sbmr = table[9];
+    bb->slx = table[10];
+    bb->sty = table[11];
+    memcpy(bb->gray, &table[12], sizeof(bb->gray));
+
+    if (bb->function & ~BITBLT_FUNCTION_MASK) return FALSE;
+
+    /* The empty (or negative) rectangles, and the ones extending past
+     * the end of the scanline are left to the microcode.
+     */
+    if (bb->dw == 0 || bb->dh == 0) return FALSE;
+    if ((bb->dw | bb->dh) & 0x8000) return FALSE;
+    if (((uint32_t) bb->dlx) + bb->dw > 0x10000) return FALSE;
+    if (USES_SOURCE(bb->function)
+        && ((uint32_t) bb->slx) + bb->dw > 0x10000)
+        return FALSE;
+
+    bb->num_words = (((bb->dlx & 15) + bb->dw - 1) >> 4) + 1;
+
+    /* Unless the source is below the destination, the scanlines are
+     * processed from the bottom to the top (like the microcode does),
+     * so that overlapping rectangles are moved correctly. Within a
+     * scanline, the whole source is read before writing the destination.
+     */
+    bb->bottom_up = ((int16_t) (bb->sty - bb->dty) <= 0);
+    return TRUE;
+}
+
+/* Obtains the scanline (relative to the top of the rectangle) that
+ * is processed at a given `step`.
+ */
+#define STEP_LINE(bb, step) \
+    ((bb)->bottom_up ? ((bb)->dh - 1 - (step)) : (step))
+
+/* Checks if the `count` words starting at `addr` are below `top`. */
+#define IS_BELOW(addr, count, top) \
+    (((uint32_t) (addr)) + (count) <= (top))
+
+/* Checks if the ranges of `count1` words starting at `addr1` and `count2`
+ * words starting at `addr2` have some word in common.
+ */
+#define OVERLAPS(addr1, count1, addr2, count2) \
+    ((((uint32_t) (addr1)) < ((uint32_t) (addr2)) + (count2)) \
+     && (((uint32_t) (addr2)) < ((uint32_t) (addr1)) + (count1)))
+
+int bitblt_check(const struct bitblt *bb, unsigned int first,
+                 unsigned int last, uint16_t top, int same_bank)
+{
+    unsigned int step, y;
+    unsigned int src_words;
+    uint16_t daddr, saddr;
+
+    src_words = 0;
+    if (USES_SOURCE(bb->function)) {
+        src_words = ((bb->slx + bb->dw - 1) >> 4) - (bb->slx >> 4) + 1;
+    }
+
+    for (step = first; step < last; step++) {
+        y = STEP_LINE(bb, step);
+
+        daddr = bb->dbca + (bb->dty + y) * bb->dbmr + (bb->dlx >> 4);
+        if (!IS_BELOW(daddr, bb->num_words, top)) return FALSE;
+
+        if (src_words == 0) continue;
+        saddr = bb->sbca + (bb->sty + y) * bb->sbmr + (bb->slx >> 4);
+        if (!IS_BELOW(saddr, src_words, top)) return FALSE;
+
+        /* The microcode interleaves the reads of the source with the
+         * writes of the destination, so when they share words within
+         * a scanline the result depends on its exact order.
+         * The word before the source is included because it may be
+         * read when aligning the source to the destination.
+         */
+        if (same_bank && OVERLAPS(daddr, bb->num_words,
+                                  saddr - 1, src_words + 1))
+            return FALSE;
+    }
+    return TRUE;
+}
+
+uint16_t bitblt_dest_addr(const struct bitblt *bb, unsigned int step)
+{
+    unsigned int y;
+
+    y = STEP_LINE(bb, step);
+    return bb->dbca + (bb->dty + y) * bb->dbmr + (bb->dlx >> 4);
+}
+
+/* Obtains the gray word used at a given `step`. Note that it follows
+ * the number of scanlines left (and not the destination y), as in the
+ * microcode.
+ */
+#define STEP_GRAY(bb, step) \
+    ((bb)->gray[((bb)->dh - 1 - (step)) & 3])
+
+/* Reads the source of the scanline processed at `step` into `bb->line`,
+ * aligned to the words of the destination. The source bitmap is in
+ * `smem`, and the gray word of the scanline is `gray`.
+ */
+static
+void read_source(struct bitblt *bb, const uint16_t *smem, unsigned int step,
+                 uint16_t gray)
+{
+    unsigned int i, n, y, shift;
+    uint16_t addr;
+    int32_t start;
+
+    n = bb->num_words;
+    y = STEP_LINE(bb, step);
+
+    if (!USES_SOURCE(bb->function)) {
+        for (i = 0; i < n; i++)
+            bb->line[i] = gray;
+        return;
+    }
+
+    /* The source bit that goes into the first bit of the first word
+     * of the destination (it can be before the source scanline).
+     */
+    start = ((int32_t) bb->slx) - (bb->dlx & 15);
+    addr = bb->sbca + (bb->sty + y) * bb->sbmr;
+    if (start < 0) {
+        addr--;
+        start += 16;
+    }
+    addr += (uint16_t) (start >> 4);
+    shift = start & 15;
+
+    if (shift == 0) {
+        for (i = 0; i < n; i++)
+            bb->line[i] = smem[(uint16_t) (addr + i)];
+    } else {
+        for (i = 0; i < n; i++) {
+            bb->line[i] = (uint16_t)
+                ((smem[(uint16_t) (addr + i)] << shift)
+                 | (smem[(uint16_t) (addr + i + 1)] >> (16 - shift)));
+        }
+    }
+
+    if ((bb->function & BITBLT_SOURCE_TYPE) == BITBLT_SRC_COMPLEMENT) {
+        for (i = 0; i < n; i++)
+            bb->line[i] = ~bb->line[i];
+    }
+}
+
+/* Combines the source `s` with the destination `d` under `mask`. */
+#define COMBINE(d, s, mask, expr) \
+    ((uint16_t) (((d) & ~(mask)) | ((expr) & (mask))))
+
+/* Applies the operation `expr` (in terms of the destination word `d`
+ * and source word `s`) to the scanline. The first and last words are
+ * masked by `lmask` and `rmask`, the other words are written whole.
+ * The bits that changed are accumulated in `diff`.
+ */
+#define APPLY_OP(expr)                                                 \
+    do {                                                               \
+        uint16_t d, s, v;                                              \
+        if (n == 1) {                                                  \
+            d = dst[addr]; s = src[0];                                 \
+            v = COMBINE(d, s, lmask & rmask, expr);                    \
+            diff |= d ^ v; dst[addr] = v;                              \
+            break;                                                     \
+        }                                                              \
+        d = dst[addr]; s = src[0];                                     \
+        v = COMBINE(d, s, lmask, expr);                                \
+        diff |= d ^ v; dst[addr] = v;                                  \
+        for (i = 1; i < n - 1; i++) {                                  \
+            d = dst[(uint16_t) (addr + i)]; s = src[i];                \
+            v = (uint16_t) (expr);                                     \
+            diff |= d ^ v; dst[(uint16_t) (addr + i)] = v;             \
+        }                                                              \
+        d = dst[(uint16_t) (addr + i)]; s = src[i];                    \
+        v = COMBINE(d, s, rmask, expr);                                \
+        diff |= d ^ v; dst[(uint16_t) (addr + i)] = v;                 \
+    } while (0)
+
+/* Writes `bb->line` to the scanline `y` of the destination bitmap
+ * (in `dmem`). The gray word of the scanline is `gray`.
+ * Returns TRUE if the contents of the scanline were changed.
+ */
+static
+int write_dest(struct bitblt *bb, uint16_t *dmem, unsigned int y,
+               uint16_t gray)
+{
+    uint16_t *dst;
+    const uint16_t *src;
+    uint16_t addr, lmask, rmask, diff;
+    unsigned int i, n;
+
+    n = bb->num_words;
+    dst = dmem;
+    src = bb->line;
+    addr = bb->dbca + (bb->dty + y) * bb->dbmr + (bb->dlx >> 4);
+    lmask = (uint16_t) (0xFFFF >> (bb->dlx & 15));
+    rmask = (uint16_t) (0xFFFF << (15 - ((bb->dlx + bb->dw - 1) & 15)));
+    diff = 0;
+
+    /* With the AndGray source type, the microcode uses the source bitmap
+     * as a mask to select between the gray (where the source is set)
+     * and the destination (elsewhere).
+     */
+    if ((bb->function & BITBLT_SOURCE_TYPE) == BITBLT_SRC_ANDGRAY) {
+        for (i = 0; i < n; i++) {
+            bb->line[i] = (bb->line[i] & gray)
+                | (dst[(uint16_t) (addr + i)] & ~bb->line[i]);
+        }
+    }
+
+    switch (bb->function & BITBLT_OPERATION) {
+    case BITBLT_OP_REPLACE:
+        APPLY_OP(s);
+        break;
+    case BITBLT_OP_PAINT:
+        APPLY_OP(d | s);
+        break;
+    case BITBLT_OP_INVERT:
+        APPLY_OP(d ^ s);
+        break;
+    case BITBLT_OP_ERASE:
+        APPLY_OP(d & ~s);
+        break;
+    }
+    return (diff != 0);
+}
+
+int bitblt_run(struct bitblt *bb, uint16_t *dmem, const uint16_t *smem,
+               unsigned int first, unsigned int last)
+{
+    unsigned int step, y;
+    uint16_t gray;
+    int changed;
+
+    changed = FALSE;
+    for (step = first; step < last; step++) {
+        gray = STEP_GRAY(bb, step);
+        read_source(bb, smem, step, gray);
+        y = STEP_LINE(bb, step);
+        if (write_dest(bb, dmem, y, gray)) changed = TRUE;
+    }
+    return changed;
+}
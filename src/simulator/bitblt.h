@@ -0,0 +1,98 @@
+
+#ifndef __SIMULATOR_BITBLT_H
+#define __SIMULATOR_BITBLT_H
+
+#include <stdint.h>
+
+/* Constants. */
+#define BITBLT_TABLE_SIZE                 16
+
+/* The fields of the function word of the BITBLT table. */
+#define BITBLT_OPERATION              0x0003 /* The operation (below). */
+#define BITBLT_SOURCE_TYPE            0x000C /* The source type (below). */
+#define BITBLT_DEST_ALT               0x0010 /* Destination in alternate
+                                              * bank.
+                                              */
+#define BITBLT_SOURCE_ALT             0x0020 /* Source in alternate bank. */
+
+/* The source types. */
+#define BITBLT_SRC_BLOCK              0x0000 /* The source bitmap. */
+#define BITBLT_SRC_COMPLEMENT         0x0004 /* The complemented source. */
+#define BITBLT_SRC_ANDGRAY            0x0008 /* The gray masked by the source. */
+#define BITBLT_SRC_GRAY               0x000C /* The gray only. */
+
+/* The operations. */
+#define BITBLT_OP_REPLACE             0x0000 /* dest = source */
+#define BITBLT_OP_PAINT               0x0001 /* dest = dest | source */
+#define BITBLT_OP_INVERT              0x0002 /* dest = dest ^ source */
+#define BITBLT_OP_ERASE               0x0003 /* dest = dest & ~source */
+
+/* The maximum number of words in a scanline of the destination. */
+#define BITBLT_MAX_LINE_WORDS           4097
+
+/* Data structures and types. */
+
+/* Structure representing a BITBLT operation. */
+struct bitblt {
+    uint16_t function;            /* The function word. */
+    uint16_t dbca;                /* Destination bitmap address. */
+    uint16_t dbmr;                /* Destination raster (words per line). */
+    uint16_t dlx;                 /* Destination left x (in bits). */
+    uint16_t dty;                 /* Destination top y. */
+    uint16_t dw;                  /* The width of the rectangle. */
+    uint16_t dh;                  /* The height of the rectangle. */
+    uint16_t sbca;                /* Source bitmap address. */
+    uint16_t sbmr;                /* Source raster (words per line). */
+    uint16_t slx;                 /* Source left x (in bits). */
+    uint16_t sty;                 /* Source top y. */
+    uint16_t gray[4];             /* The gray pattern (one word per line). */
+
+    unsigned int num_words;       /* Destination words per scanline. */
+    int bottom_up;                /* To process the scanlines from the
+                                   * bottom to the top (when the source
+                                   * overlaps the destination).
+                                   */
+    uint16_t line[BITBLT_MAX_LINE_WORDS];
+                                  /* The source of the current scanline
+                                   * (aligned to the destination words).
+                                   */
+};
+
+/* Functions. */
+
+/* Decodes a BITBLT table.
+ * The contents of the table are given by `table` (BITBLT_TABLE_SIZE
+ * words), and the operation is written to `bb`.
+ * Returns TRUE if the operation is supported (otherwise the operation
+ * should be left to the microcode).
+ */
+int bitblt_decode(struct bitblt *bb, const uint16_t *table);
+
+/* Checks the memory addresses used by a BITBLT operation.
+ * The scanlines checked are the ones processed in the steps from `first`
+ * up to (but not including) `last`. All memory accessed by the operation
+ * during these steps must be below address `top`. The parameter
+ * `same_bank` tells if the source and destination bitmaps are in the
+ * same memory bank.
+ * Returns TRUE if the addresses are valid and the operation can be
+ * performed natively (the source and destination of a scanline can not
+ * share words).
+ */
+int bitblt_check(const struct bitblt *bb, unsigned int first,
+                 unsigned int last, uint16_t top, int same_bank);
+
+/* Obtains the address of the first destination word written by a BITBLT
+ * operation at a given `step` (each step writes `bb->num_words` words).
+ */
+uint16_t bitblt_dest_addr(const struct bitblt *bb, unsigned int step);
+
+/* Performs some steps of a BITBLT operation (one scanline per step).
+ * The steps from `first` up to (but not including) `last` are performed.
+ * The bank holding the destination bitmap is `dmem`, and the one holding
+ * the source is `smem` (they may be the same).
+ * Returns TRUE if the contents of the destination were changed.
+ */
+int bitblt_run(struct bitblt *bb, uint16_t *dmem, const uint16_t *smem,
+               unsigned int first, unsigned int last);
+
+#endif /* __SIMULATOR_BITBLT_H */
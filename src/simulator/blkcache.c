@@ -0,0 +1,161 @@
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "simulator/blkcache.h"
+#include "common/utils.h"
+
+/* Functions. */
+
+void blkcache_initvar(struct blkcache *bc)
+{
+    bc->blocks = NULL;
+    bc->page_gen = NULL;
+    bc->page_used = NULL;
+}
+
+void blkcache_destroy(struct blkcache *bc)
+{
+    if (bc->blocks) free((void *) bc->blocks);
+    bc->blocks = NULL;
+
+    if (bc->page_gen) free((void *) bc->page_gen);
+    bc->page_gen = NULL;
+
+    if (bc->page_used) free((void *) bc->page_used);
+    bc->page_used = NULL;
+}
+
+int blkcache_create(struct blkcache *bc)
+{
+    blkcache_initvar(bc);
+
+    bc->blocks = (struct nova_block *)
+        malloc(BLKCACHE_SIZE * sizeof(struct nova_block));
+    bc->page_gen = (uint32_t *)
+        malloc(BLKCACHE_NUM_PAGES * sizeof(uint32_t));
+    bc->page_used = (uint8_t *)
+        malloc(BLKCACHE_NUM_PAGES * sizeof(uint8_t));
+
+    if (unlikely(!bc->blocks || !bc->page_gen || !bc->page_used)) {
+        report_error("blkcache: create: memory exhausted");
+        blkcache_destroy(bc);
+        return FALSE;
+    }
+
+    memset(bc->page_gen, 0, BLKCACHE_NUM_PAGES * sizeof(uint32_t));
+    blkcache_flush(bc);
+    return TRUE;
+}
+
+void blkcache_flush(struct blkcache *bc)
+{
+    unsigned int i;
+
+    for (i = 0; i < BLKCACHE_SIZE; i++)
+        bc->blocks[i].key = BLKCACHE_NO_KEY;
+    memset(bc->page_used, 0, BLKCACHE_NUM_PAGES * sizeof(uint8_t));
+}
+
+void blkcache_write_range(struct blkcache *bc, unsigned int bank,
+                          uint16_t addr, unsigned int count)
+{
+    uint32_t first, last, a;
+
+    if (count == 0) return;
+    first = addr;
+    last = first + count - 1;
+    for (a = first; a <= last; a += (1 << BLKCACHE_PAGE_SHIFT))
+        BLKCACHE_WRITE(bc, bank, a);
+    BLKCACHE_WRITE(bc, bank, last);
+}
+
+/* Translates the instruction word `insn` into `ni`.
+ * Returns TRUE if the instruction can be translated.
+ */
+static
+int translate_insn(struct blk_insn *ni, uint16_t insn)
+{
+    unsigned int op;
+
+    ni->insn = insn;
+    ni->ac = 0;
+    ni->mode = 0;
+    ni->indirect = 0;
+    ni->disp = 0;
+
+    if (insn & 0x8000) {
+        ni->op = BLK_OP_ALU;
+        return TRUE;
+    }
+
+    op = insn >> 11;
+    switch (op) {
+    case 0: ni->op = BLK_OP_JMP; break;
+    case 1: ni->op = BLK_OP_JSR; break;
+    case 2: ni->op = BLK_OP_ISZ; break;
+    case 3: ni->op = BLK_OP_DSZ; break;
+    case 4: case 5: case 6: case 7: ni->op = BLK_OP_LDA; break;
+    case 8: case 9: case 10: case 11: ni->op = BLK_OP_STA; break;
+    default:
+        /* The augmented instructions are left to the microcode. */
+        return FALSE;
+    }
+
+    ni->ac = op & 3;
+    ni->mode = (insn >> 8) & 3;
+    ni->indirect = (insn & 0x0400) ? 1 : 0;
+    if (ni->mode == 0) {
+        ni->disp = insn & 0xFF;
+    } else {
+        ni->disp = (uint16_t) (int8_t) (insn & 0xFF);
+    }
+    return TRUE;
+}
+
+/* Checks if the translated instruction `ni` ends a basic block. */
+static
+int ends_block(const struct blk_insn *ni)
+{
+    if (ni->op == BLK_OP_ALU) return ((ni->insn & 7) != 0);
+    return (ni->op != BLK_OP_LDA && ni->op != BLK_OP_STA);
+}
+
+const struct nova_block *blkcache_lookup(struct blkcache *bc,
+                                         unsigned int bank, uint16_t addr,
+                                         const uint16_t *mem, uint16_t top)
+{
+    struct nova_block *blk;
+    unsigned int page, n;
+    uint32_t key, a;
+
+    key = BLKCACHE_KEY(bank, addr);
+    blk = &bc->blocks[(addr ^ (bank << 10)) & (BLKCACHE_SIZE - 1)];
+    if (blk->key == key && BLKCACHE_VALID(bc, blk)) {
+        return (blk->num_insns > 0) ? blk : NULL;
+    }
+
+    /* The blocks do not cross pages, so that each block depends
+     * on the generation of a single page.
+     */
+    page = BLKCACHE_PAGE(bank, addr);
+    for (n = 0; n < BLKCACHE_MAX_INSNS; n++) {
+        a = ((uint32_t) addr) + n;
+        if (a >= top || BLKCACHE_PAGE(bank, a) != page) break;
+        if (!translate_insn(&blk->insns[n], mem[a])) break;
+        if (ends_block(&blk->insns[n])) {
+            n++;
+            break;
+        }
+    }
+
+    /* The blocks that can not be translated are also cached (with no
+     * instructions).
+     */
+    blk->key = key;
+    blk->gen = bc->page_gen[page];
+    blk->num_insns = n;
+    bc->page_used[page] = 1;
+    return (n > 0) ? blk : NULL;
+}
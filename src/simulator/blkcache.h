@@ -0,0 +1,138 @@
+
+#ifndef __SIMULATOR_BLKCACHE_H
+#define __SIMULATOR_BLKCACHE_H
+
+#include <stdint.h>
+
+/* Constants. */
+#define BLKCACHE_MAX_INSNS                16 /* Maximum number of
+                                              * instructions per block.
+                                              */
+#define BLKCACHE_SIZE                   4096 /* Number of blocks in the
+                                              * cache (a power of 2).
+                                              */
+#define BLKCACHE_PAGE_SHIFT                8 /* Pages of 256 words. */
+#define BLKCACHE_NUM_PAGES              1024 /* Pages in the 4 banks. */
+#define BLKCACHE_NO_KEY          0xFFFFFFFFU /* Key of the empty blocks. */
+
+/* The operations of the translated instructions. */
+enum blk_op {
+    BLK_OP_ALU,                   /* Arithmetic and logic instructions. */
+    BLK_OP_JMP,                   /* Jump. */
+    BLK_OP_JSR,                   /* Jump to subroutine. */
+    BLK_OP_ISZ,                   /* Increment and skip if zero. */
+    BLK_OP_DSZ,                   /* Decrement and skip if zero. */
+    BLK_OP_LDA,                   /* Load accumulator. */
+    BLK_OP_STA                    /* Store accumulator. */
+};
+
+/* Data structures and types. */
+
+/* A translated nova instruction. */
+struct blk_insn {
+    uint16_t insn;                /* The instruction word. */
+    uint16_t disp;                /* The displacement (sign extended,
+                                   * except in page zero mode).
+                                   */
+    uint8_t op;                   /* The operation (enum blk_op). */
+    uint8_t ac;                   /* The accumulator (LDA and STA). */
+    uint8_t mode;                 /* The addressing mode (0 to 3). */
+    uint8_t indirect;             /* If the addressing is indirect. */
+};
+
+/* A basic block of translated nova instructions. The block ends at the
+ * first instruction that can change the flow of control (jumps and
+ * skips), at the first instruction that can not be translated, or at
+ * the end of the page.
+ */
+struct nova_block {
+    uint32_t key;                 /* The bank and address of the first
+                                   * instruction (see BLKCACHE_KEY()).
+                                   */
+    uint32_t gen;                 /* The generation of the page when the
+                                   * block was translated.
+                                   */
+    unsigned int num_insns;       /* The number of instructions. */
+    struct blk_insn insns[BLKCACHE_MAX_INSNS];
+                                  /* The translated instructions. */
+};
+
+/* The cache of translated blocks. */
+struct blkcache {
+    struct nova_block *blocks;    /* The blocks (direct mapped). */
+    uint32_t *page_gen;           /* The generation of each page (it
+                                   * changes when a page with translated
+                                   * blocks is written).
+                                   */
+    uint8_t *page_used;           /* If the page has translated blocks. */
+};
+
+/* Functions. */
+
+/* Obtains the key of the block at `addr` in memory bank `bank`. */
+#define BLKCACHE_KEY(bank, addr) \
+    ((((uint32_t) (bank)) << 16) | ((uint16_t) (addr)))
+
+/* Obtains the page of the address `addr` in memory bank `bank`. */
+#define BLKCACHE_PAGE(bank, addr) \
+    ((((unsigned int) (bank)) << (16 - BLKCACHE_PAGE_SHIFT)) \
+     | (((uint16_t) (addr)) >> BLKCACHE_PAGE_SHIFT))
+
+/* Invalidates the blocks of the page that contains the address `addr`
+ * in memory bank `bank` (to be used when the address is written).
+ */
+#define BLKCACHE_WRITE(bc, bank, addr)                                 \
+    do {                                                               \
+        unsigned int _page = BLKCACHE_PAGE(bank, addr);                \
+        if (unlikely((bc)->page_used[_page])) {                        \
+            (bc)->page_used[_page] = 0;                                \
+            (bc)->page_gen[_page]++;                                   \
+        }                                                              \
+    } while (0)
+
+/* Checks if the block `blk` is still valid (its page was not written
+ * since it was translated).
+ */
+#define BLKCACHE_VALID(bc, blk) \
+    ((blk)->gen == (bc)->page_gen[BLKCACHE_PAGE((blk)->key >> 16, \
+                                                (blk)->key)])
+
+/* Initializes the block cache variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void blkcache_initvar(struct blkcache *bc);
+
+/* Destroys the block cache object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void blkcache_destroy(struct blkcache *bc);
+
+/* Creates a new block cache object.
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int blkcache_create(struct blkcache *bc);
+
+/* Invalidates all the blocks in the cache. */
+void blkcache_flush(struct blkcache *bc);
+
+/* Invalidates the blocks of the pages with the `count` words starting
+ * at address `addr` in memory bank `bank`.
+ */
+void blkcache_write_range(struct blkcache *bc, unsigned int bank,
+                          uint16_t addr, unsigned int count);
+
+/* Obtains the block that starts at address `addr` in memory bank `bank`.
+ * The contents of the bank are given by `mem`. The block is translated
+ * if it is not in the cache. Only the instructions below `top` are
+ * translated.
+ * Returns the block, or NULL if the instruction at `addr` can not be
+ * translated.
+ */
+const struct nova_block *blkcache_lookup(struct blkcache *bc,
+                                         unsigned int bank, uint16_t addr,
+                                         const uint16_t *mem, uint16_t top);
+
+#endif /* __SIMULATOR_BLKCACHE_H */
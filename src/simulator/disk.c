@@ -76,6 +76,16 @@
 #define WT_DATA                            1
 #define WT_SYNC                            2
 
+/* The tasks of the disk controller. */
+#define DISK_TASKS \
+    ((1 << TASK_DISK_SECTOR) | (1 << TASK_DISK_WORD))
+
+/* Static function declarations. */
+static int ds_interrupt(void *arg, int64_t cycle);
+static int dw_interrupt(void *arg, int64_t cycle);
+static int seek_interrupt(void *arg, int64_t cycle);
+static int seclate_interrupt(void *arg, int64_t cycle);
+
 /* Functions. */
 
 void disk_initvar(struct disk *dsk)
@@ -100,13 +110,27 @@ void disk_destroy(struct disk *dsk)
     }
 }
 
-int disk_create(struct disk *dsk)
+int disk_create(struct disk *dsk, struct intr_scheduler *sched)
 {
     struct disk_drive *dd;
     unsigned int dnum;
 
     disk_initvar(dsk);
 
+    dsk->sched = sched;
+    if (unlikely(!intr_register(sched, "disk sector", &ds_interrupt,
+                                dsk, &dsk->ds_timer)
+                 || !intr_register(sched, "disk word", &dw_interrupt,
+                                   dsk, &dsk->dw_timer)
+                 || !intr_register(sched, "disk seek", &seek_interrupt,
+                                   dsk, &dsk->seek_timer)
+                 || !intr_register(sched, "disk seclate",
+                                   &seclate_interrupt,
+                                   dsk, &dsk->seclate_timer))) {
+        report_error("disk: create: could not register timers");
+        return FALSE;
+    }
+
     for (dnum = 0; dnum < NUM_DISK_DRIVES; dnum++) {
         dd = &dsk->drives[dnum];
 
@@ -136,6 +160,7 @@ int disk_create(struct disk *dsk)
         dd->loaded = FALSE;
     }
 
+    dsk->fast = FALSE;
     disk_reset(dsk);
     return TRUE;
 }
@@ -356,12 +381,16 @@ void disk_reset(struct disk *dsk)
     dsk->bitclk_enable = FALSE;
     dsk->wdinit = FALSE;
 
-    dsk->intr_cycle = 1;
-    dsk->ds_intr_cycle = 1;
-    dsk->dw_intr_cycle = -1;
-    dsk->seek_intr_cycle = -1;
-    dsk->seclate_intr_cycle = -1;
-    dsk->pending = 0;
+    intr_schedule(dsk->sched, dsk->ds_timer, 1);
+    intr_cancel(dsk->sched, dsk->dw_timer);
+    intr_cancel(dsk->sched, dsk->seek_timer);
+    intr_cancel(dsk->sched, dsk->seclate_timer);
+    dsk->sched->pending &= ~DISK_TASKS;
+}
+
+void disk_set_fast(struct disk *dsk, int enable)
+{
+    dsk->fast = enable;
 }
 
 uint16_t disk_read_kstat(const struct disk *dsk)
@@ -481,6 +510,27 @@ void disk_load_kcomm(struct disk *dsk, uint16_t bus)
     }
 }
 
+/* Rotates the disk so that the sector in KDATA is under the head
+ * (in the fast disk mode). This is only done at the beginning of the
+ * sector, before the header record, so that no word of the sector has
+ * been transferred yet.
+ */
+static
+void rotate_to_sector(struct disk *dsk)
+{
+    struct disk_drive *dd;
+    uint16_t sector;
+
+    dd = &dsk->drives[dsk->disk];
+    sector = (dsk->kdata >> AW_SECTOR_SHIFT) & AW_SECTOR_MASK;
+    if (!dd->loaded || sector >= dd->dg.num_sectors) return;
+    if (dd->sector_word >= DS_HEADER) return;
+
+    dd->sector = sector;
+    dsk->kstat &= ~(AW_SECTOR_MASK << AW_SECTOR_SHIFT);
+    dsk->kstat |= (sector << AW_SECTOR_SHIFT);
+}
+
 void disk_load_kadr(struct disk *dsk, uint16_t bus)
 {
     struct disk_drive *dd;
@@ -554,9 +604,11 @@ void disk_load_kadr(struct disk *dsk, uint16_t bus)
     if ((dsk->kdata >> AW_RESTORE_SHIFT) & 1) {
         dsk->restore = TRUE;
     }
+
+    if (dsk->fast) rotate_to_sector(dsk);
 }
 
-int disk_func_strobe(struct disk *dsk, int32_t cycle)
+int disk_func_strobe(struct disk *dsk, int64_t cycle)
 {
     uint16_t cylinder;
     struct disk_drive *dd;
@@ -582,12 +634,23 @@ int disk_func_strobe(struct disk *dsk, int32_t cycle)
         return TRUE;
     }
 
+    if (dsk->fast) {
+        /* The heads arrive at the cylinder at once. */
+        dd->cylinder = cylinder;
+        dd->target_cylinder = cylinder;
+        dsk->restore = FALSE;
+        dsk->kstat &= ~(KSTAT_SEEKING | KSTAT_SEEK_FAIL);
+        intr_cancel(dsk->sched, dsk->seek_timer);
+        return TRUE;
+    }
+
     dsk->kstat &= ~KSTAT_SEEK_FAIL;
     dsk->kstat |= KSTAT_SEEKING;
 
     dd->target_cylinder = cylinder;
 
-    dsk->seek_intr_cycle = INTR_CYCLE(cycle + SEEK_DURATION);
+    intr_schedule(dsk->sched, dsk->seek_timer,
+                  cycle + INTR_DURATION(dsk->sched, SEEK_DURATION));
     return TRUE;
 }
 
@@ -709,15 +772,17 @@ void disk_block_task(struct disk *dsk, uint8_t task)
     if (task == TASK_DISK_WORD) {
         dsk->wdinit = FALSE;
     }
-    dsk->pending &= ~(1 << task);
+    INTR_BLOCK(dsk->sched, task);
 }
 
 /* Disk sector interrupt routine. */
 static
-void ds_interrupt(struct disk *dsk)
+int ds_interrupt(void *arg, int64_t cycle)
 {
+    struct disk *dsk;
     struct disk_drive *dd;
 
+    dsk = (struct disk *) arg;
     dd = &dsk->drives[dsk->disk];
 
     dd->sector = dd->sector + 1;
@@ -739,22 +804,42 @@ void ds_interrupt(struct disk *dsk)
 
 
     if (!(dsk->kstat & KSTAT_SEEKING)) {
-        dsk->pending |= (1 << TASK_DISK_SECTOR);
+        INTR_WAKEUP(dsk->sched, TASK_DISK_SECTOR);
 
         dsk->seclate_enable = TRUE;
         dsk->kstat &= ~(KSTAT_LATE);
 
-        dsk->dw_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + WORD_DURATION);
+        intr_schedule(dsk->sched, dsk->dw_timer,
+                      cycle + INTR_DURATION(dsk->sched, WORD_DURATION));
 
-        dsk->ds_intr_cycle = -1;
+        intr_cancel(dsk->sched, dsk->ds_timer);
 
-        dsk->seclate_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SECLATE_DURATION);
+        intr_schedule(dsk->sched, dsk->seclate_timer,
+                      cycle + INTR_DURATION(dsk->sched,
+                                            SECLATE_DURATION));
     } else {
-        dsk->ds_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SECTOR_DURATION);
+        intr_schedule(dsk->sched, dsk->ds_timer,
+                      cycle + INTR_DURATION(dsk->sched, SECTOR_DURATION));
     }
+    return TRUE;
+}
+
+/* Obtains the sector under the head of the current disk.
+ * Returns a pointer to the sector.
+ */
+static
+struct disk_sector *current_sector(struct disk *dsk)
+{
+    struct disk_drive *dd;
+    uint16_t vda;
+
+    dd = &dsk->drives[dsk->disk];
+    vda = dd->cylinder;
+    vda *= dd->dg.num_heads;
+    vda += dd->head;
+    vda *= dd->dg.num_sectors;
+    vda += dd->sector;
+    return &dd->sectors[vda];
 }
 
 /* Obtains a word from the sector.
@@ -824,30 +909,105 @@ uint16_t *get_sector_word(struct disk_sector *ds,
     return NULL;
 }
 
+/* Obtains the current operation (read, check or write) on the record.
+ * Returns the operation (0 to 3) as in the KADR register.
+ */
+static
+uint16_t record_oper(const struct disk *dsk)
+{
+    int shift;
+
+    shift = KADR_HEADER_SHIFT - (KADR_SINGLE_SHIFT * (dsk->rec_no & 3));
+    return (dsk->kadr >> shift) & KADR_BLOCK_MASK;
+}
+
+uint16_t *disk_pending_words(struct disk *dsk, uint16_t *count,
+                             int *is_write)
+{
+    struct disk_drive *dd;
+    struct disk_sector *ds;
+    uint16_t *record;
+    uint16_t start, size, oper;
+
+    dd = &dsk->drives[dsk->disk];
+    if (!dd->loaded) return NULL;
+    if (dsk->kstat & (KSTAT_LATE | KSTAT_SEEKING)) return NULL;
+    if (dsk->kcomm & (KCOMM_XFEROFF | KCOMM_WDINHB)) return NULL;
+    if (!(dsk->kcomm & KCOMM_WFFO) && !dsk->bitclk_enable) return NULL;
+
+    oper = record_oper(dsk);
+    if (oper == 1) return NULL; /* CHECK */
+    *is_write = (oper >= 2);
+    if (*is_write && !dsk->sync_word_written) return NULL;
+
+    ds = current_sector(dsk);
+    switch (dsk->rec_no & 3) {
+    case 0:
+        record = ds->header;
+        start = DS_HEADER;
+        size = DS_HEADER_DSIZE;
+        break;
+    case 1:
+        record = ds->label;
+        start = DS_LABEL;
+        size = DS_LABEL_DSIZE;
+        break;
+    case 2:
+        record = ds->data;
+        start = DS_DATA;
+        size = DS_DATA_DSIZE;
+        break;
+    default:
+        return NULL;
+    }
+
+    /* Only the words between the sync word and the checksum. */
+    if (dd->sector_word <= start || dd->sector_word >= start + size - 1)
+        return NULL;
+
+    *count = start + size - 1 - dd->sector_word;
+    return &record[dd->sector_word - start];
+}
+
+void disk_skip_words(struct disk *dsk, uint16_t count)
+{
+    struct disk_drive *dd;
+    uint16_t *w;
+    int word_type;
+
+    if (count == 0) return;
+
+    dd = &dsk->drives[dsk->disk];
+    dd->sector_word += count;
+
+    w = get_sector_word(current_sector(dsk), dd->sector_word - 1,
+                        &word_type);
+    if (record_oper(dsk) >= 2) {
+        dsk->kdata = w[0];
+        dsk->has_kdata = FALSE;
+    }
+    dsk->kdata_read = w[0];
+}
+
 /* Disk word interrupt routine. */
 static
-void dw_interrupt(struct disk *dsk)
+int dw_interrupt(void *arg, int64_t cycle)
 {
+    struct disk *dsk;
     struct disk_drive *dd;
     struct disk_sector *ds;
-    uint16_t vda, oper;
+    uint16_t oper;
     uint16_t *w, wv;
-    int shift;
     int bWakeup, seclate;
     int wdInhib, bClkSource;
     int wffo, xferOff;
     int is_write;
     int word_type;
 
+    dsk = (struct disk *) arg;
     dd = &dsk->drives[dsk->disk];
 
-    vda = dd->cylinder;
-    vda *= dd->dg.num_heads;
-    vda += dd->head;
-    vda *= dd->dg.num_sectors;
-    vda += dd->sector;
-
-    ds = &dd->sectors[vda];
+    ds = current_sector(dsk);
     w = get_sector_word(ds, dd->sector_word, &word_type);
     wv = (word_type == WT_GAP) ? 0 : w[0];
 
@@ -857,8 +1017,7 @@ void dw_interrupt(struct disk *dsk)
     wffo = (dsk->kcomm & KCOMM_WFFO);
     xferOff = (dsk->kcomm & KCOMM_XFEROFF);
 
-    shift = KADR_HEADER_SHIFT - (KADR_SINGLE_SHIFT * (dsk->rec_no & 3));
-    oper = (dsk->kadr >> shift) & KADR_BLOCK_MASK;
+    oper = record_oper(dsk);
     is_write = (oper >= 2);
 
     bWakeup = (!seclate && !wdInhib && !bClkSource);
@@ -905,26 +1064,28 @@ void dw_interrupt(struct disk *dsk)
     dd->sector_word++;
 
     if (bWakeup) {
-        dsk->pending |= (1 << TASK_DISK_WORD);
+        INTR_WAKEUP(dsk->sched, TASK_DISK_WORD);
     }
 
     if (dd->sector_word < DS_END) {
-        dsk->dw_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + WORD_DURATION);
+        intr_schedule(dsk->sched, dsk->dw_timer,
+                      cycle + INTR_DURATION(dsk->sched, WORD_DURATION));
     } else {
-        dsk->dw_intr_cycle = -1;
+        intr_cancel(dsk->sched, dsk->dw_timer);
 
-        dsk->ds_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + 1);
+        intr_schedule(dsk->sched, dsk->ds_timer, cycle + 1);
     }
+    return TRUE;
 }
 
 /* Seek interrupt routine. */
 static
-void seek_interrupt(struct disk *dsk)
+int seek_interrupt(void *arg, int64_t cycle)
 {
+    struct disk *dsk;
     struct disk_drive *dd;
 
+    dsk = (struct disk *) arg;
     dd = &dsk->drives[dsk->disk];
 
     if (dd->cylinder < dd->target_cylinder) {
@@ -936,62 +1097,42 @@ void seek_interrupt(struct disk *dsk)
     if (dd->cylinder == dd->target_cylinder) {
         dsk->kstat &= ~KSTAT_SEEKING;
         dsk->restore = FALSE;
-        dsk->seek_intr_cycle = -1;
+        intr_cancel(dsk->sched, dsk->seek_timer);
     } else {
-        dsk->seek_intr_cycle =
-            INTR_CYCLE(dsk->intr_cycle + SEEK_DURATION);
+        intr_schedule(dsk->sched, dsk->seek_timer,
+                      cycle + INTR_DURATION(dsk->sched, SEEK_DURATION));
     }
+    return TRUE;
 }
 
 /* SECLATE interrupt routine. */
 static
-void seclate_interrupt(struct disk *dsk)
+int seclate_interrupt(void *arg, int64_t cycle)
 {
+    struct disk *dsk;
+
+    UNUSED(cycle);
+    dsk = (struct disk *) arg;
     if (dsk->seclate_enable) {
         dsk->kstat |= KSTAT_LATE;
     }
-    dsk->seclate_intr_cycle = -1;
+    intr_cancel(dsk->sched, dsk->seclate_timer);
+    return TRUE;
 }
 
-/* Updates the intr_cycle.
- * Returns TRUE on success.
+/* Obtains the cycle of the next interrupt of the disk controller.
+ * Returns the cycle (or a negative value if none is scheduled).
  */
 static
-int update_intr_cycle(struct disk *dsk)
+int64_t get_intr_cycle(const struct disk *dsk)
 {
-    int32_t intr_cycles[4];
-
-    intr_cycles[0] = dsk->ds_intr_cycle;
-    intr_cycles[1] = dsk->dw_intr_cycle;
-    intr_cycles[2] = dsk->seek_intr_cycle;
-    intr_cycles[3] = dsk->seclate_intr_cycle;
-
-    if (unlikely(!compute_intr_cycle(dsk->intr_cycle, TRUE,
-                                     4, intr_cycles,
-                                     &dsk->intr_cycle))) {
-        report_error("disk: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        return FALSE;
-    }
-
-    return TRUE;
-}
-
-int disk_interrupt(struct disk *dsk)
-{
-    int has_ds, has_dw, has_seek, has_seclate;
-
-    has_ds = (dsk->intr_cycle == dsk->ds_intr_cycle);
-    has_dw = (dsk->intr_cycle == dsk->dw_intr_cycle);
-    has_seek = (dsk->intr_cycle == dsk->seek_intr_cycle);
-    has_seclate = (dsk->intr_cycle == dsk->seclate_intr_cycle);
-
-    if (has_ds) ds_interrupt(dsk);
-    if (has_dw) dw_interrupt(dsk);
-    if (has_seek) seek_interrupt(dsk);
-    if (has_seclate) seclate_interrupt(dsk);
+    unsigned int ids[4];
 
-    return update_intr_cycle(dsk);
+    ids[0] = dsk->ds_timer;
+    ids[1] = dsk->dw_timer;
+    ids[2] = dsk->seek_timer;
+    ids[3] = dsk->seclate_timer;
+    return intr_earliest_cycle(dsk->sched, 4, ids);
 }
 
 void disk_on_switch_task(struct disk *dsk, uint8_t task)
@@ -1114,19 +1255,19 @@ void disk_print_registers(const struct disk *dsk,
                         DECODE_VALUE, dd->dg.num_cylinders);
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE, dsk->pending);
-    decode_tagged_value(dec->vdec, "ICYC",
-                        DECODE_SVALUE32, dsk->intr_cycle);
-    decode_tagged_value(dec->vdec, "DS_ICYC",
-                        DECODE_SVALUE32, dsk->ds_intr_cycle);
-    decode_tagged_value(dec->vdec, "DW_ICYC",
-                        DECODE_SVALUE32, dsk->dw_intr_cycle);
+    decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE,
+                        dsk->sched->pending & DISK_TASKS);
+    decode_tagged_cycle(dec->vdec, "ICYC", get_intr_cycle(dsk));
+    decode_tagged_cycle(dec->vdec, "DS_ICYC",
+                        intr_timer_cycle(dsk->sched, dsk->ds_timer));
+    decode_tagged_cycle(dec->vdec, "DW_ICYC",
+                        intr_timer_cycle(dsk->sched, dsk->dw_timer));
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "SK_ICYC",
-                        DECODE_SVALUE32, dsk->seek_intr_cycle);
-    decode_tagged_value(dec->vdec, "SL_ICYC",
-                        DECODE_SVALUE32, dsk->seclate_intr_cycle);
+    decode_tagged_cycle(dec->vdec, "SK_ICYC",
+                        intr_timer_cycle(dsk->sched, dsk->seek_timer));
+    decode_tagged_cycle(dec->vdec, "SL_ICYC",
+                        intr_timer_cycle(dsk->sched, dsk->seclate_timer));
     string_buffer_print(output, "\n");
 }
 
@@ -1148,12 +1289,12 @@ void disk_serialize(const struct disk *dsk, struct serdes *sd)
     serdes_put_bool(sd, dsk->bitclk_enable);
     serdes_put_bool(sd, dsk->wdinit);
     serdes_put_bool(sd, dsk->seclate_enable);
-    serdes_put32(sd, dsk->intr_cycle);
-    serdes_put32(sd, dsk->ds_intr_cycle);
-    serdes_put32(sd, dsk->dw_intr_cycle);
-    serdes_put32(sd, dsk->seek_intr_cycle);
-    serdes_put32(sd, dsk->seclate_intr_cycle);
-    serdes_put16(sd, dsk->pending);
+    serdes_put64(sd, get_intr_cycle(dsk));
+    serdes_put64(sd, intr_timer_cycle(dsk->sched, dsk->ds_timer));
+    serdes_put64(sd, intr_timer_cycle(dsk->sched, dsk->dw_timer));
+    serdes_put64(sd, intr_timer_cycle(dsk->sched, dsk->seek_timer));
+    serdes_put64(sd, intr_timer_cycle(dsk->sched, dsk->seclate_timer));
+    serdes_put16(sd, dsk->sched->pending & DISK_TASKS);
 
     for (drive_num = 0; drive_num < NUM_DISK_DRIVES; drive_num++) {
         dd = &dsk->drives[drive_num];
@@ -1185,12 +1326,16 @@ void disk_deserialize(struct disk *dsk, struct serdes *sd)
     dsk->bitclk_enable = serdes_get_bool(sd);
     dsk->wdinit = serdes_get_bool(sd);
     dsk->seclate_enable = serdes_get_bool(sd);
-    dsk->intr_cycle = serdes_get32(sd);
-    dsk->ds_intr_cycle = serdes_get32(sd);
-    dsk->dw_intr_cycle = serdes_get32(sd);
-    dsk->seek_intr_cycle = serdes_get32(sd);
-    dsk->seclate_intr_cycle = serdes_get32(sd);
-    dsk->pending = serdes_get16(sd);
+    serdes_get64(sd); /* The next interrupt cycle (not needed). */
+    intr_schedule(dsk->sched, dsk->ds_timer,
+                  (int64_t) serdes_get64(sd));
+    intr_schedule(dsk->sched, dsk->dw_timer,
+                  (int64_t) serdes_get64(sd));
+    intr_schedule(dsk->sched, dsk->seek_timer,
+                  (int64_t) serdes_get64(sd));
+    intr_schedule(dsk->sched, dsk->seclate_timer,
+                  (int64_t) serdes_get64(sd));
+    dsk->sched->pending |= serdes_get16(sd) & DISK_TASKS;
 
     for (drive_num = 0; drive_num < NUM_DISK_DRIVES; drive_num++) {
         dd = &dsk->drives[drive_num];
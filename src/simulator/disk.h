@@ -18,6 +18,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -81,13 +82,15 @@ struct disk {
     int bitclk_enable;            /* Disk bit counter enabled. */
     int wdinit;                   /* WDINIT bit used by task. */
     int seclate_enable;           /* To enable SECLATE. */
-
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t ds_intr_cycle;        /* Disk sector interrupt cycle. */
-    int32_t dw_intr_cycle;        /* Disk word interrupt cycle. */
-    int32_t seek_intr_cycle;      /* Seek interrupt cycle. */
-    int32_t seclate_intr_cycle;   /* SECLATE interrupt cycle. */
-    uint16_t pending;             /* The task pending mask. */
+    int fast;                     /* Fast disk mode (no seek and no
+                                   * rotational latency).
+                                   */
+
+    struct intr_scheduler *sched; /* The event scheduler. */
+    unsigned int ds_timer;        /* Disk sector timer. */
+    unsigned int dw_timer;        /* Disk word timer. */
+    unsigned int seek_timer;      /* Seek timer. */
+    unsigned int seclate_timer;   /* SECLATE timer. */
 };
 
 /* Functions. */
@@ -106,9 +109,11 @@ void disk_destroy(struct disk *dsk);
 
 /* Creates a new disk object.
  * This obeys the initvar / destroy / create protocol.
+ * The timers of the disk controller are registered in the event
+ * scheduler `sched`.
  * Returns TRUE on success.
  */
-int disk_create(struct disk *dsk);
+int disk_create(struct disk *dsk, struct intr_scheduler *sched);
 
 /* Reads the contents of the disk from a disk pack file named `filename`.
  * Returns TRUE on success.
@@ -130,6 +135,15 @@ int disk_unload(struct disk *dsk, unsigned int drive_num);
 /* Resets the disk controller. */
 void disk_reset(struct disk *dsk);
 
+/* Enables or disables the fast disk mode.
+ * In this mode, the seeks complete immediately, and the sector requested
+ * by the disk sector task (when it writes to KADR) is rotated under the
+ * head at once, as long as no word of the current sector has been
+ * transferred yet. The timing of the words inside the sector is kept.
+ * The parameter `enable` tells whether to enable the fast mode.
+ */
+void disk_set_fast(struct disk *dsk, int enable);
+
 /* Reads the KSTAT register.
  * Returns the contents of the KSTAT register.
  */
@@ -166,7 +180,7 @@ void disk_load_kadr(struct disk *dsk, uint16_t bus);
  * The `cycle` parameter specifies the current cycle.
  * Returns TRUE on success.
  */
-int disk_func_strobe(struct disk *dsk, int32_t cycle);
+int disk_func_strobe(struct disk *dsk, int64_t cycle);
 
 /* Executes a F1_DSK_INCRECNO.
  * Increases the record number. Each sector has 3 data records:
@@ -258,16 +272,30 @@ uint16_t disk_func_nfer(const struct disk *dsk, uint8_t task);
  */
 uint16_t disk_func_strobon(const struct disk *dsk, uint8_t task);
 
+/* Obtains the words of the current record that are still to pass under
+ * the head (for the native transfers, see simulator_set_native_disk()).
+ * This only succeeds while a plain read or write of the record is in
+ * progress, and the checksum word is never included.
+ * The number of words is returned in `count` and whether the record is
+ * being written in `is_write`.
+ * Returns a pointer to the first of these words in the disk sector,
+ * or NULL if no such transfer is in progress.
+ */
+uint16_t *disk_pending_words(struct disk *dsk, uint16_t *count,
+                             int *is_write);
+
+/* Advances the disk by `count` words of the current record, as if they
+ * had passed under the head (the words should have been obtained with
+ * disk_pending_words(), and written already in the case of a write).
+ * The KDATA register is left with the last of these words.
+ */
+void disk_skip_words(struct disk *dsk, uint16_t count);
+
 /* Processes a BLOCK instruction.
  * The task to be blocked is in the parameter `task`.
  */
 void disk_block_task(struct disk *dsk, uint8_t task);
 
-/* Processes the disk interrupts.
- * Returns TRUE on success.
- */
-int disk_interrupt(struct disk *dsk);
-
 /* Callback for when the simulation switches to a disk task.
  * The new task is given by `task`.
  */
@@ -2,6 +2,7 @@
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include "simulator/display.h"
 #include "simulator/intr.h"
@@ -29,7 +30,7 @@
  * The period of the clock is then:  158.73ns
  */
 #define FIFO_SIZE                         16
-#define SCANLINE_WORDS                    38  /* Visible at full bit clock. */
+#define SCANLINE_WORDS    DISPLAY_LINE_WORDS  /* Visible at full bit clock. */
 #define SCANLINE_DURATION                240  /*    38 us / 150.73 ns */
 #define HBLANK_DURATION                   45  /*  7.14 us / 158.73 ns */
 #define SCANLINE_VISIBLE_DURATION  (SCANLINE_DURATION - HBLANK_DURATION)
@@ -41,37 +42,98 @@
 #define MODE_LOWRES                   0x8000
 #define MODE_WOB                      0x4000
 
+/* The tasks of the display controller. */
+#define DISPLAY_TASKS \
+    ((1 << TASK_MEMORY_REFRESH) | (1 << TASK_DISPLAY_WORD) \
+     | (1 << TASK_CURSOR) | (1 << TASK_DISPLAY_HORIZONTAL) \
+     | (1 << TASK_DISPLAY_VERTICAL))
+
+/* Tables to expand the pixels of the display. They are built by the
+ * macro TABLE_256, which applies the macro `f` to every byte.
+ */
+#define TABLE_4(f, b)    f(b), f((b) + 1), f((b) + 2), f((b) + 3)
+#define TABLE_16(f, b) \
+    TABLE_4(f, b), TABLE_4(f, (b) + 4), \
+    TABLE_4(f, (b) + 8), TABLE_4(f, (b) + 12)
+#define TABLE_64(f, b) \
+    TABLE_16(f, b), TABLE_16(f, (b) + 16), \
+    TABLE_16(f, (b) + 32), TABLE_16(f, (b) + 48)
+#define TABLE_256(f) \
+    TABLE_64(f, 0), TABLE_64(f, 64), TABLE_64(f, 128), TABLE_64(f, 192)
+
+#define PIXEL(b, bit)           (((b) & (bit)) ? 0xFF : 0x00)
+#define EXPAND_BYTE(b) \
+    { PIXEL(b, 0x80), PIXEL(b, 0x40), PIXEL(b, 0x20), PIXEL(b, 0x10), \
+      PIXEL(b, 0x08), PIXEL(b, 0x04), PIXEL(b, 0x02), PIXEL(b, 0x01) }
+#define DOUBLE_BYTE(b) \
+    ((((b) & 0x01) * 0x0003) | (((b) & 0x02) * 0x0006) \
+     | (((b) & 0x04) * 0x000C) | (((b) & 0x08) * 0x0018) \
+     | (((b) & 0x10) * 0x0030) | (((b) & 0x20) * 0x0060) \
+     | (((b) & 0x40) * 0x00C0) | (((b) & 0x80) * 0x0180))
+
+/* The 8 pixels of each byte (the most significant bit first). */
+static const uint8_t expand_table[256][8] = { TABLE_256(EXPAND_BYTE) };
+
+/* Each byte with its bits doubled (for the low resolution mode). */
+static const uint16_t double_table[256] = { TABLE_256(DOUBLE_BYTE) };
+
+/* Static function declarations. */
+static int dhl_interrupt(void *arg, int64_t cycle);
+static int dw_interrupt(void *arg, int64_t cycle);
+static void render_scanline(struct display *displ);
+
 /* Functions. */
 
 void display_initvar(struct display *displ)
 {
-    displ->display_data = NULL;
+    displ->lines = NULL;
     displ->fifo = NULL;
+    displ->line = NULL;
 }
 
 void display_destroy(struct display *displ)
 {
-    if (displ->display_data) free((void *) displ->display_data);
-    displ->display_data = NULL;
+    if (displ->lines) free((void *) displ->lines);
+    displ->lines = NULL;
 
     if (displ->fifo) free((void *) displ->fifo);
     displ->fifo = NULL;
+
+    if (displ->line) free((void *) displ->line);
+    displ->line = NULL;
 }
 
-int display_create(struct display *displ)
+int display_create(struct display *displ, struct intr_scheduler *sched)
 {
     display_initvar(displ);
 
+    displ->sched = sched;
+    if (unlikely(!intr_register(sched, "display half-line",
+                                &dhl_interrupt, displ, &displ->dhl_timer)
+                 || !intr_register(sched, "display word",
+                                   &dw_interrupt, displ,
+                                   &displ->dw_timer))) {
+        report_error("display: create: could not register timers");
+        return FALSE;
+    }
+
     displ->fifo = (uint16_t *) malloc(FIFO_SIZE * sizeof(uint16_t));
-    displ->display_data = (uint8_t *)
-        malloc(DISPLAY_DATA_SIZE * sizeof(uint8_t));
+    displ->line = (uint16_t *) malloc(SCANLINE_WORDS * sizeof(uint16_t));
+    displ->lines = (struct display_line *)
+        malloc(DISPLAY_HEIGHT * sizeof(struct display_line));
 
-    if (unlikely(!displ->fifo || !displ->display_data)) {
+    if (unlikely(!displ->fifo || !displ->line || !displ->lines)) {
         report_error("display: create: memory exhausted");
         display_destroy(displ);
         return FALSE;
     }
 
+    /* The whole screen is new. */
+    memset(displ->lines, 0, DISPLAY_HEIGHT * sizeof(struct display_line));
+    memset(&displ->row, 0, sizeof(struct display_line));
+    memset(displ->dirty, 0xFF, sizeof(displ->dirty));
+
+    displ->fast = FALSE;
     display_reset(displ);
     return TRUE;
 }
@@ -79,6 +141,7 @@ int display_create(struct display *displ)
 void display_reset(struct display *displ)
 {
     displ->fifo_start = displ->fifo_end = 0;
+    displ->line_words = 0;
 
     displ->even_field = FALSE;
     displ->hblank = FALSE;
@@ -99,10 +162,11 @@ void display_reset(struct display *displ)
     displ->dw_blocked = FALSE;
     displ->cur_blocked = FALSE;
 
-    displ->dw_intr_cycle = 0xFFFFFFFFU;
-    displ->dhl_intr_cycle = SCANLINE_VISIBLE_DURATION;
-    displ->intr_cycle = displ->dhl_intr_cycle;
-    displ->pending = 0;
+    intr_cancel(displ->sched, displ->dw_timer);
+    intr_schedule(displ->sched, displ->dhl_timer,
+                  INTR_DURATION(displ->sched, SCANLINE_VISIBLE_DURATION));
+    displ->sched->pending &= ~DISPLAY_TASKS;
+    displ->refresh_wakeup = FALSE;
 }
 
 /* Returns the scanline where the vblanking ends.
@@ -141,11 +205,105 @@ int is_fifo_almost_full(struct display *displ)
     return (displ->fifo_end >= displ->fifo_start + FIFO_SIZE - 4);
 }
 
+void display_set_fast(struct display *displ, int enable)
+{
+    displ->fast = enable;
+
+    /* The words already loaded for this scanline are dropped. */
+    displ->fifo_start = displ->fifo_end = 0;
+    displ->line_words = 0;
+    intr_cancel(displ->sched, displ->dw_timer);
+}
+
+void display_copy_dirty(struct display *displ, struct display_line *lines,
+                        uint32_t *dirty)
+{
+    uint32_t bits;
+    unsigned int i, y, n;
+
+    if (!dirty) {
+        memcpy(lines, displ->lines,
+               DISPLAY_HEIGHT * sizeof(struct display_line));
+        memset(displ->dirty, 0, sizeof(displ->dirty));
+        return;
+    }
+
+    for (i = 0; i < DISPLAY_DIRTY_WORDS; i++) {
+        bits = displ->dirty[i];
+        if (!bits) continue;
+
+        dirty[i] |= bits;
+        displ->dirty[i] = 0;
+
+        /* Copy each run of consecutive dirty lines at once. */
+        y = 32 * i;
+        while (bits) {
+            while (!(bits & 1)) {
+                bits >>= 1;
+                y++;
+            }
+            for (n = 0; bits & 1; n++)
+                bits >>= 1;
+
+            if (y >= DISPLAY_HEIGHT) break;
+            if (y + n > DISPLAY_HEIGHT) n = DISPLAY_HEIGHT - y;
+
+            memcpy(&lines[y], &displ->lines[y],
+                   n * sizeof(struct display_line));
+            y += n;
+        }
+    }
+}
+
+void display_render_line(const struct display_line *line, uint8_t *pixels)
+{
+    uint16_t bits[DISPLAY_LINE_WORDS];
+    uint16_t w, x, shift;
+    unsigned int i;
+
+    if (line->flags & DISPLAY_LINE_LOW_RES) {
+        for (i = 0; i < DISPLAY_LINE_WORDS / 2; i++) {
+            w = line->words[i];
+            bits[2 * i] = double_table[w >> 8];
+            bits[2 * i + 1] = double_table[w & 0xFF];
+        }
+    } else {
+        memcpy(bits, line->words, sizeof(bits));
+    }
+
+    /* The cursor is always drawn with the color of the 1 bits. */
+    x = line->cursor_x;
+    if (x < DISPLAY_STRIDE) {
+        shift = x & 15;
+        bits[x >> 4] |= line->cursor_data >> shift;
+        if (shift != 0 && (x >> 4) + 1 < DISPLAY_LINE_WORDS) {
+            bits[(x >> 4) + 1] |=
+                (uint16_t) (line->cursor_data << (16 - shift));
+        }
+    }
+
+    for (i = 0; i < DISPLAY_LINE_WORDS; i++) {
+        w = bits[i];
+        if (!(line->flags & DISPLAY_LINE_WOB))
+            w = ~w;
+        memcpy(&pixels[16 * i], expand_table[w >> 8], 8);
+        memcpy(&pixels[16 * i + 8], expand_table[w & 0xFF], 8);
+    }
+}
+
 int display_load_ddr(struct display *displ, uint16_t bus)
 {
     uint8_t pos;
     int fifo_full;
 
+    if (displ->fast) {
+        /* The words that do not fit in the scanline are never seen. */
+        if (displ->line_words < SCANLINE_WORDS) {
+            displ->line[displ->line_words++] = bus;
+        }
+        return TRUE;
+    }
+
     fifo_full = is_fifo_full(displ);
     if (!fifo_full) {
         pos = displ->fifo_end++;
@@ -157,7 +315,7 @@ int display_load_ddr(struct display *displ, uint16_t bus)
     }
 
     if (is_fifo_almost_full(displ)) {
-        displ->pending &= ~(1 << TASK_DISPLAY_WORD);
+        INTR_BLOCK(displ->sched, TASK_DISPLAY_WORD);
     }
     return TRUE;
 }
@@ -189,24 +347,27 @@ void display_block_task(struct display *displ, uint8_t task)
     if (task == TASK_DISPLAY_WORD) {
         displ->dw_blocked = TRUE;
         if (!displ->dh_blocked) {
-            displ->pending |= (1 << TASK_DISPLAY_HORIZONTAL);
+            INTR_WAKEUP(displ->sched, TASK_DISPLAY_HORIZONTAL);
         }
     } else if (task == TASK_DISPLAY_HORIZONTAL) {
         displ->dh_blocked = TRUE;
-        displ->pending &= ~(1 << TASK_DISPLAY_WORD);
+        INTR_BLOCK(displ->sched, TASK_DISPLAY_WORD);
     } else if (task == TASK_CURSOR) {
         displ->cur_blocked = TRUE;
     }
-    displ->pending &= ~(1 << task);
+    INTR_BLOCK(displ->sched, task);
 }
 
 /* Display half-line interrupt routine. */
 static
-void dhl_interrupt(struct display *displ)
+int dhl_interrupt(void *arg, int64_t cycle)
 {
+    struct display *displ;
     uint16_t vblank_thresh;
     int almost_full, vblank;
 
+    displ = (struct display *) arg;
+
     if (displ->hblank) {
         vblank_thresh = vblank_threshold(displ);
 
@@ -217,8 +378,8 @@ void dhl_interrupt(struct display *displ)
             displ->cur_blocked = FALSE;
             displ->even_field = 1 - displ->even_field;
 
-            displ->pending |= (1 << TASK_DISPLAY_VERTICAL)
-                | (1 << TASK_DISPLAY_HORIZONTAL);
+            INTR_WAKEUP(displ->sched, TASK_DISPLAY_VERTICAL);
+            INTR_WAKEUP(displ->sched, TASK_DISPLAY_HORIZONTAL);
         }
 
         displ->word = 0;
@@ -232,69 +393,159 @@ void dhl_interrupt(struct display *displ)
         displ->wob_latched = displ->wob;
 
         displ->hblank = FALSE;
-        displ->dhl_intr_cycle =
-            INTR_CYCLE(displ->intr_cycle + SCANLINE_VISIBLE_DURATION);
+        intr_schedule(displ->sched, displ->dhl_timer,
+                      cycle + INTR_DURATION(displ->sched,
+                                            SCANLINE_VISIBLE_DURATION));
     } else {
+        /* Render the scanline that has just ended. */
+        if (displ->fast && displ->scanline >= vblank_threshold(displ)) {
+            render_scanline(displ);
+        }
+
          /* Wakup the memory refresh task (and possibly the
-          * ethernet task).
+          * ethernet task, see refresh_wakeup).
           */
-        displ->pending |= (1 << TASK_MEMORY_REFRESH)
-            | (1 << TASK_ETHERNET);
+        INTR_WAKEUP(displ->sched, TASK_MEMORY_REFRESH);
+        displ->refresh_wakeup = TRUE;
 
         /* Also wakeup the cursor task, if not blocked. */
         if (!displ->cur_blocked) {
-            displ->pending |= (1 << TASK_CURSOR);
+            INTR_WAKEUP(displ->sched, TASK_CURSOR);
         }
 
         displ->dw_blocked = FALSE;
 
         displ->hblank = TRUE;
-        displ->dhl_intr_cycle =
-            INTR_CYCLE(displ->intr_cycle + HBLANK_DURATION);
+        intr_schedule(displ->sched, displ->dhl_timer,
+                      cycle + INTR_DURATION(displ->sched, HBLANK_DURATION));
     }
 
     /* Check if the word task should be awakened. */
-    almost_full = is_fifo_almost_full(displ);
+    almost_full = (!displ->fast && is_fifo_almost_full(displ));
     vblank_thresh = vblank_threshold(displ);
     vblank = (displ->scanline < vblank_thresh);
 
     if (almost_full || vblank || displ->hblank
         || displ->dh_blocked || displ->dw_blocked) {
-        displ->pending &= ~(1 << TASK_DISPLAY_WORD);
+        INTR_BLOCK(displ->sched, TASK_DISPLAY_WORD);
     } else {
-        displ->pending |= (1 << TASK_DISPLAY_WORD);
+        INTR_WAKEUP(displ->sched, TASK_DISPLAY_WORD);
     }
 
-    if (!vblank && !displ->hblank) {
+    if (!vblank && !displ->hblank && !displ->fast) {
         /* One word that is always skipped (see schematics of buffer control),
          * pluts the time of the first word to be displayed.
          */
         if (displ->low_res_latched) {
-            displ->dw_intr_cycle =
-                INTR_CYCLE(displ->intr_cycle + 4 * WORD_DURATION);
+            intr_schedule(displ->sched, displ->dw_timer,
+                          cycle + INTR_DURATION(displ->sched,
+                                                4 * WORD_DURATION));
         } else {
-            displ->dw_intr_cycle =
-                INTR_CYCLE(displ->intr_cycle + 2 * WORD_DURATION);
+            intr_schedule(displ->sched, displ->dw_timer,
+                          cycle + INTR_DURATION(displ->sched,
+                                                2 * WORD_DURATION));
         }
     }
+    return TRUE;
 }
 
 
-/* Display word interrupt routine. */
+/* Obtains the line of the display for the current scanline.
+ * Returns the line number.
+ */
 static
-void dw_interrupt(struct display *displ)
+uint16_t scanline_line(const struct display *displ)
 {
-    uint16_t adj_scanline;
-    uint16_t to_display, d;
-    uint16_t x_offset, x;
-    uint8_t *data, data1;
-    int i, almost_full;
-
     if (displ->even_field) {
-        adj_scanline = 2 * (displ->scanline - VBLANK_SCANLINES_EVEN);
+        return 2 * (displ->scanline - VBLANK_SCANLINES_EVEN);
     } else {
-        adj_scanline = 2 * (displ->scanline - VBLANK_SCANLINES_ODD) + 1;
+        return 2 * (displ->scanline - VBLANK_SCANLINES_ODD) + 1;
     }
+}
+
+/* Starts drawing the current scanline (in `row`), from the
+ * line already in the display.
+ */
+static
+void begin_scanline(struct display *displ)
+{
+    displ->row = displ->lines[scanline_line(displ)];
+}
+
+/* Finishes drawing the current scanline. The line of the display is
+ * only written (and marked as dirty) when it changed.
+ */
+static
+void end_scanline(struct display *displ)
+{
+    struct display_line *line;
+    uint16_t y;
+
+    /* The modes are latched for the whole scanline. */
+    displ->row.flags = 0;
+    if (displ->low_res_latched)
+        displ->row.flags |= DISPLAY_LINE_LOW_RES;
+    if (displ->wob_latched)
+        displ->row.flags |= DISPLAY_LINE_WOB;
+
+    y = scanline_line(displ);
+    line = &displ->lines[y];
+    if (memcmp(line, &displ->row, sizeof(struct display_line)) != 0) {
+        *line = displ->row;
+        DISPLAY_SET_DIRTY(displ->dirty, y);
+    }
+}
+
+/* Draws the word `to_display` at position `word` of the scanline. */
+static
+void draw_word(struct display *displ, uint16_t word, uint16_t to_display)
+{
+    if (likely(word < SCANLINE_WORDS))
+        displ->row.words[word] = to_display;
+}
+
+/* Draws the cursor on the scanline. */
+static
+void draw_cursor(struct display *displ)
+{
+    displ->row.cursor_x = displ->cursor_x_latched;
+    displ->row.cursor_data = displ->cursor_data_latched;
+}
+
+/* Renders the whole scanline in one pass (in the fast display mode).
+ * The words that were not loaded by the display word task are shown
+ * as blank, the same way as when the FIFO runs empty.
+ */
+static
+void render_scanline(struct display *displ)
+{
+    uint16_t word, num_words;
+
+    num_words = SCANLINE_WORDS;
+    if (displ->low_res_latched)
+        num_words /= 2;
+
+    begin_scanline(displ);
+    for (word = 0; word < num_words; word++) {
+        draw_word(displ, word,
+                  (word < displ->line_words) ? displ->line[word] : 0);
+    }
+    draw_cursor(displ);
+    end_scanline(displ);
+
+    displ->word = num_words;
+    displ->line_words = 0;
+}
+
+/* Display word interrupt routine. */
+static
+int dw_interrupt(void *arg, int64_t cycle)
+{
+    struct display *displ;
+    uint16_t to_display;
+    int almost_full;
+
+    displ = (struct display *) arg;
 
     if (!is_fifo_empty(displ)) {
         to_display = displ->fifo[displ->fifo_start++];
@@ -308,96 +559,46 @@ void dw_interrupt(struct display *displ)
 
     almost_full = is_fifo_almost_full(displ);
     if (almost_full || displ->dh_blocked || displ->dw_blocked) {
-        displ->pending &= ~(1 << TASK_DISPLAY_WORD);
+        INTR_BLOCK(displ->sched, TASK_DISPLAY_WORD);
     } else {
-        displ->pending |= (1 << TASK_DISPLAY_WORD);
+        INTR_WAKEUP(displ->sched, TASK_DISPLAY_WORD);
     }
 
-    if (!displ->wob_latched)
-        to_display = ~to_display;
-
-    x_offset = displ->word * 16;
-    if (displ->low_res_latched)
-        x_offset *= 2;
-
     /* Display the to_display word. */
-    data = &displ->display_data[adj_scanline * DISPLAY_STRIDE];
-    x = x_offset;
-    d = to_display;
-    for (i = 0; i < 16; i++) {
-        data1 = (d & 0x8000) ? 0xFF : 0x00;
-        data[x++] = data1;
-        if (displ->low_res_latched) {
-            data[x++] = data1;
-        }
-        d <<= 1;
-    }
+    if (displ->word == 0)
+        begin_scanline(displ);
+    draw_word(displ, displ->word, to_display);
 
     displ->word++;
     if (!(displ->hblank)) {
         /* More words to process. */
-        displ->dw_intr_cycle = displ->intr_cycle;
-        displ->dw_intr_cycle += (displ->low_res_latched)
-            ? 2 * WORD_DURATION : WORD_DURATION;
-        displ->dw_intr_cycle = INTR_CYCLE(displ->dw_intr_cycle);
-        return;
+        cycle += INTR_DURATION(displ->sched, (displ->low_res_latched)
+                               ? 2 * WORD_DURATION : WORD_DURATION);
+        intr_schedule(displ->sched, displ->dw_timer, cycle);
+        return TRUE;
     }
 
     /* We are the end of a scanline. */
-    displ->dw_intr_cycle = -1;
-
-    if (displ->cursor_x_latched < DISPLAY_STRIDE) {
-        /* Draw cursor. */
-        x = displ->cursor_x_latched;
-        d = displ->cursor_data_latched;
-        for (i = 0; i < 16; i++) {
-            data1 = (d & 0x8000) ? 0xFF : 0x00;
-            if (displ->wob_latched) {
-                data[x++] |= data1;
-            } else {
-                data[x++] &= ~data1;
-            }
-            if (x >= DISPLAY_STRIDE) break;
-            d <<= 1;
-        }
-    }
+    intr_cancel(displ->sched, displ->dw_timer);
+    draw_cursor(displ);
+    end_scanline(displ);
 
     /* Clear the buffers here. */
     displ->fifo_start = displ->fifo_end = 0;
+    return TRUE;
 }
 
-/* Updates the intr_cycle.
- * Returns TRUE on success.
+/* Obtains the cycle of the next interrupt of the display controller.
+ * Returns the cycle (or a negative value if none is scheduled).
  */
 static
-int update_intr_cycle(struct display *displ)
+int64_t get_intr_cycle(const struct display *displ)
 {
-    int32_t intr_cycles[2];
-
-    intr_cycles[0] = displ->dhl_intr_cycle;
-    intr_cycles[1] = displ->dw_intr_cycle;
-
-    if (unlikely(!compute_intr_cycle(displ->intr_cycle, TRUE,
-                                     2, intr_cycles,
-                                     &displ->intr_cycle))) {
-        report_error("display: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        return FALSE;
-    }
-    return TRUE;
-}
-
-int display_interrupt(struct display *displ)
-{
-    int has_dhl, has_dw;
-
-    has_dhl = (displ->intr_cycle == displ->dhl_intr_cycle);
-    has_dw = (displ->intr_cycle == displ->dw_intr_cycle);
-
-    if (has_dhl) dhl_interrupt(displ);
-    if (has_dw) dw_interrupt(displ);
+    unsigned int ids[2];
 
-    return update_intr_cycle(displ);
+    ids[0] = displ->dhl_timer;
+    ids[1] = displ->dw_timer;
+    return intr_earliest_cycle(displ->sched, 2, ids);
 }
 
 void display_on_switch_task(struct display *displ, uint8_t task)
@@ -406,7 +607,7 @@ void display_on_switch_task(struct display *displ, uint8_t task)
         return;
 
     /* Automatically blocks task on switch. */
-    displ->pending &= ~(1 << task);
+    INTR_BLOCK(displ->sched, task);
 }
 
 void display_print_registers(const struct display *displ,
@@ -452,16 +653,15 @@ void display_print_registers(const struct display *displ,
                         DECODE_BOOL, displ->dw_blocked);
     decode_tagged_value(dec->vdec, "CUR_BLOCK",
                         DECODE_BOOL, displ->cur_blocked);
-    decode_tagged_value(dec->vdec, "PEND",
-                        DECODE_VALUE, displ->pending);
+    decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE,
+                        displ->sched->pending & DISPLAY_TASKS);
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "ICYC",
-                        DECODE_SVALUE32, displ->intr_cycle);
-    decode_tagged_value(dec->vdec, "DHL_ICYC",
-                        DECODE_SVALUE32, displ->dhl_intr_cycle);
-    decode_tagged_value(dec->vdec, "DW_ICYC",
-                        DECODE_SVALUE32, displ->dw_intr_cycle);
+    decode_tagged_cycle(dec->vdec, "ICYC", get_intr_cycle(displ));
+    decode_tagged_cycle(dec->vdec, "DHL_ICYC",
+                        intr_timer_cycle(displ->sched, displ->dhl_timer));
+    decode_tagged_cycle(dec->vdec, "DW_ICYC",
+                        intr_timer_cycle(displ->sched, displ->dw_timer));
     string_buffer_print(output, "\n");
 
     decode_tagged_value(dec->vdec, "FIFO_ST",
@@ -500,10 +700,10 @@ void display_serialize(const struct display *displ, struct serdes *sd)
     serdes_put_bool(sd, displ->dh_blocked);
     serdes_put_bool(sd, displ->dw_blocked);
     serdes_put_bool(sd, displ->cur_blocked);
-    serdes_put32(sd, displ->intr_cycle);
-    serdes_put32(sd, displ->dhl_intr_cycle);
-    serdes_put32(sd, displ->dw_intr_cycle);
-    serdes_put16(sd, displ->pending);
+    serdes_put64(sd, get_intr_cycle(displ));
+    serdes_put64(sd, intr_timer_cycle(displ->sched, displ->dhl_timer));
+    serdes_put64(sd, intr_timer_cycle(displ->sched, displ->dw_timer));
+    serdes_put16(sd, displ->sched->pending & DISPLAY_TASKS);
 }
 
 void display_deserialize(struct display *displ, struct serdes *sd)
@@ -526,8 +726,19 @@ void display_deserialize(struct display *displ, struct serdes *sd)
     displ->dh_blocked = serdes_get_bool(sd);
     displ->dw_blocked = serdes_get_bool(sd);
     displ->cur_blocked = serdes_get_bool(sd);
-    displ->intr_cycle = serdes_get32(sd);
-    displ->dhl_intr_cycle = serdes_get32(sd);
-    displ->dw_intr_cycle = serdes_get32(sd);
-    displ->pending = serdes_get16(sd);
+    serdes_get64(sd); /* The next interrupt cycle (not needed). */
+    intr_schedule(displ->sched, displ->dhl_timer,
+                  (int64_t) serdes_get64(sd));
+    intr_schedule(displ->sched, displ->dw_timer,
+                  (int64_t) serdes_get64(sd));
+    displ->sched->pending |= serdes_get16(sd) & DISPLAY_TASKS;
+    displ->refresh_wakeup = FALSE;
+
+    /* The words of the scanline are not saved in the fast mode. */
+    displ->line_words = 0;
+    if (displ->fast) intr_cancel(displ->sched, displ->dw_timer);
+
+    /* Restart the scanline being drawn from the pixels in the display. */
+    if (displ->word != 0 && displ->scanline >= vblank_threshold(displ))
+        begin_scanline(displ);
 }
@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -12,22 +13,62 @@
 #define DISPLAY_WIDTH                    606
 #define DISPLAY_HEIGHT                   808
 #define DISPLAY_STRIDE                   608
-#define DISPLAY_DATA_SIZE (DISPLAY_STRIDE * DISPLAY_HEIGHT)
+#define DISPLAY_LINE_WORDS  (DISPLAY_STRIDE / 16)
+#define DISPLAY_DIRTY_WORDS ((DISPLAY_HEIGHT + 31) / 32)
+
+/* Macros to manipulate the bitmaps of dirty lines (arrays of
+ * DISPLAY_DIRTY_WORDS words, with one bit per line of the display).
+ */
+#define DISPLAY_SET_DIRTY(dirty, y) \
+    ((dirty)[(y) >> 5] |= (((uint32_t) 1) << ((y) & 31)))
+#define DISPLAY_IS_DIRTY(dirty, y) \
+    (((dirty)[(y) >> 5] >> ((y) & 31)) & 1)
+
+/* Flags of a line of the display. */
+#define DISPLAY_LINE_LOW_RES               1
+#define DISPLAY_LINE_WOB                   2
 
 /* Data structures and types. */
 
+/* A line of the display, as seen by the display controller. The pixels
+ * are only expanded to bytes by display_render_line(), when they are
+ * presented.
+ */
+struct display_line {
+    uint16_t words[DISPLAY_LINE_WORDS];
+                                  /* The words of the scanline (only
+                                   * the first half in low resolution).
+                                   */
+    uint16_t cursor_x;            /* The cursor X position. */
+    uint16_t cursor_data;         /* The cursor data. */
+    uint16_t flags;               /* The flags (DISPLAY_LINE_*). */
+};
+
 /* The display controller structure used by the simulator. */
 struct display {
-    uint8_t *display_data;        /* The display pixels.
-                                   * Here we use bytes instead of
-                                   * bits because most graphics libraries
-                                   * do not suport 1BPP pixel formats.
+    struct display_line *lines;   /* The lines of the display. */
+    struct display_line row;      /* The scanline being drawn (it is
+                                   * copied to `lines` at the end of
+                                   * the scanline, if it changed).
+                                   */
+    uint32_t dirty[DISPLAY_DIRTY_WORDS];
+                                  /* The lines that changed since the
+                                   * last call to display_copy_dirty().
                                    */
     uint16_t *fifo;               /* The data buffer implementing
                                    * the pixel FIFO.
                                    */
     uint8_t fifo_start, fifo_end; /* To control the FIFO. */
 
+    int fast;                     /* Fast display mode (the words of the
+                                   * scanline are collected in `line` and
+                                   * rendered at once).
+                                   */
+    uint16_t *line;               /* The words of the scanline (in the
+                                   * fast display mode).
+                                   */
+    uint8_t line_words;           /* The number of words in `line`. */
+
     int even_field;               /* If this is an even or odd field. */
     int hblank;                   /* If it is in a H-blanking period. */
     uint16_t scanline;            /* The current scanline. */
@@ -53,10 +94,13 @@ struct display {
     int dw_blocked;               /* Display word task blocked itself. */
     int cur_blocked;              /* Cursor task blocked itself. */
 
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t dhl_intr_cycle;       /* Display half-line interrupt cycle. */
-    int32_t dw_intr_cycle;        /* Display word interrupt cycle. */
-    uint16_t pending;             /* The task pending mask. */
+    struct intr_scheduler *sched; /* The event scheduler. */
+    unsigned int dhl_timer;       /* Display half-line timer. */
+    unsigned int dw_timer;        /* Display word timer. */
+    int refresh_wakeup;           /* The memory refresh task was woken up
+                                   * (this also ticks the countdown wakeup
+                                   * of the ethernet controller).
+                                   */
 };
 
 /* Functions. */
@@ -75,13 +119,38 @@ void display_destroy(struct display *displ);
 
 /* Creates a new display object.
  * This obeys the initvar / destroy / create protocol.
+ * The timers of the display controller are registered in the event
+ * scheduler `sched`.
  * Returns TRUE on success.
  */
-int display_create(struct display *displ);
+int display_create(struct display *displ, struct intr_scheduler *sched);
 
 /* Resets the display controller. */
 void display_reset(struct display *displ);
 
+/* Enables or disables the fast display mode.
+ * In this mode, the words of the scanline are not paced by the display
+ * word timer. The display word task runs until it blocks itself, and
+ * the scanline is rendered at once when the horizontal blanking starts.
+ * The parameter `enable` tells whether to enable the fast mode.
+ */
+void display_set_fast(struct display *displ, int enable);
+
+/* Copies the lines of the display that changed since the last call
+ * into `lines` (an array of DISPLAY_HEIGHT lines). The lines copied are
+ * also marked in the dirty bitmap `dirty` (which is not cleared). If
+ * `dirty` is NULL, all lines are copied.
+ */
+void display_copy_dirty(struct display *displ, struct display_line *lines,
+                        uint32_t *dirty);
+
+/* Renders the line `line` of the display into `pixels`, with one byte
+ * per pixel (0x00 for black and 0xFF for white). The low resolution
+ * mode, white on black mode and the cursor are applied here.
+ * Exactly DISPLAY_STRIDE pixels are written.
+ */
+void display_render_line(const struct display_line *line, uint8_t *pixels);
+
 /* Loads a word into the data display register.
  * The word from the bus to load is given by `bus`.
  * Returns TRUE on success.
@@ -117,11 +186,6 @@ uint16_t display_set_mode(struct display *displ, uint16_t bus);
  */
 void display_block_task(struct display *displ, uint8_t task);
 
-/* Processes the display interrupts.
- * Returns TRUE on success.
- */
-int display_interrupt(struct display *displ);
-
 /* Callback for when the simulation switches to a display task.
  * The new task is given by `task`.
  */
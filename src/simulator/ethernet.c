@@ -27,6 +27,10 @@
 #define IST_RECEIVING                      2
 #define IST_DONE                           3
 
+/* Static function declarations. */
+static int tx_interrupt(void *arg, int64_t cycle);
+static int rx_interrupt(void *arg, int64_t cycle);
+
 /* Functions. */
 
 void ethernet_initvar(struct ethernet *ether)
@@ -40,10 +44,19 @@ void ethernet_destroy(struct ethernet *ether)
     ether->fifo = NULL;
 }
 
-int ethernet_create(struct ethernet *ether)
+int ethernet_create(struct ethernet *ether, struct intr_scheduler *sched)
 {
     ethernet_initvar(ether);
 
+    ether->sched = sched;
+    if (unlikely(!intr_register(sched, "ethernet tx", &tx_interrupt,
+                                ether, &ether->tx_timer)
+                 || !intr_register(sched, "ethernet rx", &rx_interrupt,
+                                   ether, &ether->rx_timer))) {
+        report_error("ethernet_create: could not register timers");
+        return FALSE;
+    }
+
     ether->fifo =
         (uint16_t *) malloc(FIFO_SIZE * sizeof(uint16_t));
 
@@ -106,42 +119,7 @@ int reset_interface(struct ethernet *ether)
     }
 
     ether->fifo_start = ether->fifo_end = 0;
-    ether->pending &= ~(1 << TASK_ETHERNET);
-    return TRUE;
-}
-
-/* Updates the intr_cycle. The parameter `cycle` specifies the current
- * cycle. The parameter `must_advance` is passed to the compute_intr_cycle()
- * function.
- * Returns TRUE on success.
- */
-static
-int update_intr_cycle(struct ethernet *ether,
-                      int32_t cycle, int must_advance)
-{
-    int32_t intr_cycles[2];
-    int32_t diff;
-
-    intr_cycles[0] = ether->tx_intr_cycle;
-    intr_cycles[1] = ether->rx_intr_cycle;
-
-    /* If the current interrupt cycle is set, use the minimum
-     * between intr_cycle and cycle.
-     */
-    if (ether->intr_cycle >= 0) {
-        diff = INTR_CYCLE(cycle - ether->intr_cycle);
-        if (!INTR_DIFF_NEG(diff)) {
-            cycle = ether->intr_cycle;
-        }
-    }
-
-    if (unlikely(!compute_intr_cycle(cycle, must_advance,
-                                     2, intr_cycles,
-                                     &ether->intr_cycle))) {
-        report_error("ethernet: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        return FALSE;
-    }
+    INTR_BLOCK(ether->sched, TASK_ETHERNET);
     return TRUE;
 }
 
@@ -151,15 +129,11 @@ int update_intr_cycle(struct ethernet *ether,
  * Returns TRUE on success.
  */
 static
-int transmit_fifo(struct ethernet *ether, int32_t cycle, int end_tx)
+int transmit_fifo(struct ethernet *ether, int64_t cycle, int end_tx)
 {
-    ether->tx_intr_cycle = INTR_CYCLE(cycle + TX_DURATION);
+    intr_schedule(ether->sched, ether->tx_timer,
+                  cycle + INTR_DURATION(ether->sched, TX_DURATION));
     ether->end_tx = end_tx;
-    if (unlikely(!update_intr_cycle(ether, cycle, FALSE))) {
-        report_error("ethernet: transmit_fifo: "
-                     "could not update the interrupt cycle");
-        return FALSE;
-    }
     return TRUE;
 }
 
@@ -189,9 +163,9 @@ uint16_t read_input_fifo(struct ethernet *ether, int peek)
     if (ether->fifo_end < ether->fifo_start + 2) {
         if (ether->in_gone) {
             ether->in_busy = FALSE;
-            ether->pending |= (1 << TASK_ETHERNET);
+            INTR_WAKEUP(ether->sched, TASK_ETHERNET);
         } else {
-            ether->pending &= ~(1 << TASK_ETHERNET);
+            INTR_BLOCK(ether->sched, TASK_ETHERNET);
         }
     }
     return output;
@@ -204,7 +178,7 @@ uint16_t read_input_fifo(struct ethernet *ether, int peek)
  */
 static
 int write_output_fifo(struct ethernet *ether, uint16_t bus,
-                      int32_t cycle)
+                      int64_t cycle)
 {
     uint8_t pos;
     if (ether->fifo_end < ether->fifo_start + FIFO_SIZE) {
@@ -226,7 +200,7 @@ int write_output_fifo(struct ethernet *ether, uint16_t bus,
                 return FALSE;
             }
         }
-        ether->pending &= ~(1 << TASK_ETHERNET);
+        INTR_BLOCK(ether->sched, TASK_ETHERNET);
     }
 
     return TRUE;
@@ -239,7 +213,7 @@ void ethernet_set_address(struct ethernet *ether, uint16_t address)
 
 int ethernet_reset(struct ethernet *ether)
 {
-    ether->pending = 0;
+    INTR_BLOCK(ether->sched, TASK_ETHERNET);
     ether->countdown_wakeup = FALSE;
     ether->end_tx = FALSE;
 
@@ -248,9 +222,8 @@ int ethernet_reset(struct ethernet *ether)
         (*ether->trp->clear_tx)(ether->trp->arg);
     }
 
-    ether->intr_cycle = -1;
-    ether->tx_intr_cycle = -1;
-    ether->rx_intr_cycle = -1;
+    intr_cancel(ether->sched, ether->tx_timer);
+    intr_cancel(ether->sched, ether->rx_timer);
 
     if (unlikely(!reset_interface(ether))) {
         report_error("ethernet: reset: "
@@ -269,7 +242,7 @@ uint16_t ethernet_rsnf(struct ethernet *ether)
 void ethernet_startf(struct ethernet *ether, uint16_t bus)
 {
     ether->iocmd = (bus & 0x03);
-    ether->pending |= (1 << TASK_ETHERNET);
+    INTR_WAKEUP(ether->sched, TASK_ETHERNET);
 }
 
 uint16_t ethernet_eilfct(struct ethernet *ether)
@@ -303,7 +276,7 @@ void ethernet_ewfct(struct ethernet *ether)
     ether->countdown_wakeup = TRUE;
 }
 
-int ethernet_eodfct(struct ethernet *ether, uint16_t bus, int32_t cycle)
+int ethernet_eodfct(struct ethernet *ether, uint16_t bus, int64_t cycle)
 {
     if (unlikely(!write_output_fifo(ether, bus, cycle))) {
         report_error("ethernet: eodfct: "
@@ -316,7 +289,7 @@ int ethernet_eodfct(struct ethernet *ether, uint16_t bus, int32_t cycle)
 void ethernet_eosfct(struct ethernet *ether)
 {
     ether->out_busy = TRUE;
-    ether->pending |= (1 << TASK_ETHERNET);
+    INTR_WAKEUP(ether->sched, TASK_ETHERNET);
 }
 
 uint16_t ethernet_erbfct(struct ethernet *ether)
@@ -324,14 +297,14 @@ uint16_t ethernet_erbfct(struct ethernet *ether)
     return ((ether->iocmd & 3) << 2);
 }
 
-int ethernet_eefct(struct ethernet *ether, int32_t cycle)
+int ethernet_eefct(struct ethernet *ether, int64_t cycle)
 {
     if (unlikely(!transmit_fifo(ether, cycle, TRUE))) {
         report_error("ethernet: eefct: "
                      "could not transmit FIFO");
         return FALSE;
     }
-    ether->pending &= ~(1 << TASK_ETHERNET);
+    INTR_BLOCK(ether->sched, TASK_ETHERNET);
     return TRUE;
 }
 
@@ -359,7 +332,7 @@ uint16_t ethernet_ecbfct(struct ethernet *ether)
     return 0x0;
 }
 
-int ethernet_eisfct(struct ethernet *ether, int32_t cycle)
+int ethernet_eisfct(struct ethernet *ether, int64_t cycle)
 {
     int ret;
 
@@ -378,32 +351,30 @@ int ethernet_eisfct(struct ethernet *ether, int32_t cycle)
     ether->input_state = IST_WAITING;
     ether->in_busy = TRUE;
 
-    ether->pending &= ~(1 << TASK_ETHERNET);
-    if (ether->rx_intr_cycle < 0) {
-        ether->rx_intr_cycle = INTR_CYCLE(cycle + RX_DURATION);
-        ret = update_intr_cycle(ether, cycle, FALSE);
-        if (unlikely(!ret)) {
-            report_error("ethernet: eisfct: "
-                         "could not update the interrupt cycle");
-            return FALSE;
-        }
+    INTR_BLOCK(ether->sched, TASK_ETHERNET);
+    if (intr_timer_cycle(ether->sched, ether->rx_timer) < 0) {
+        intr_schedule(ether->sched, ether->rx_timer,
+                      cycle + INTR_DURATION(ether->sched, RX_DURATION));
     }
     return TRUE;
 }
 
 void ethernet_block_task(struct ethernet *ether, uint8_t task)
 {
-    ether->pending &= ~(1 << task);
+    INTR_BLOCK(ether->sched, task);
 }
 
 /* Transmission interrupt. */
 static
-int tx_interrupt(struct ethernet *ether)
+int tx_interrupt(void *arg, int64_t cycle)
 {
+    struct ethernet *ether;
     uint16_t data;
     int ret;
 
-    ether->tx_intr_cycle = -1;
+    UNUSED(cycle);
+    ether = (struct ethernet *) arg;
+    intr_cancel(ether->sched, ether->tx_timer);
     if (!ether->out_busy) return TRUE;
 
     while (ether->fifo_start != ether->fifo_end) {
@@ -424,7 +395,7 @@ int tx_interrupt(struct ethernet *ether)
     }
     ether->fifo_start = ether->fifo_end = 0;
 
-    ether->pending |= (1 << TASK_ETHERNET);
+    INTR_WAKEUP(ether->sched, TASK_ETHERNET);
 
     if (ether->end_tx) {
         int ret;
@@ -444,12 +415,14 @@ int tx_interrupt(struct ethernet *ether)
 
 /* Receiving data interrupt. */
 static
-int rx_interrupt(struct ethernet *ether)
+int rx_interrupt(void *arg, int64_t cycle)
 {
+    struct ethernet *ether;
     size_t len, rem;
     int is_active;
     int ret;
 
+    ether = (struct ethernet *) arg;
     if (ether->trp) {
         ret = (*ether->trp->receive)(ether->trp->arg, &len);
         if (unlikely(!ret)) {
@@ -497,13 +470,13 @@ int rx_interrupt(struct ethernet *ether)
                 /* Clear the current RX packet. */
                 (*ether->trp->clear_rx)(ether->trp->arg);
                 ether->input_state = IST_DONE;
-                ether->pending |= (1 << TASK_ETHERNET);
+                INTR_WAKEUP(ether->sched, TASK_ETHERNET);
                 is_active = FALSE;
             }
         }
 
         if (ether->fifo_end >= ether->fifo_start + 2) {
-            ether->pending |= (1 << TASK_ETHERNET);
+            INTR_WAKEUP(ether->sched, TASK_ETHERNET);
         }
 
         break;
@@ -527,36 +500,12 @@ int rx_interrupt(struct ethernet *ether)
     }
 
     if (is_active) {
-        ether->rx_intr_cycle =
-            INTR_CYCLE(ether->intr_cycle + RX_DURATION);
+        intr_schedule(ether->sched, ether->rx_timer,
+                      cycle + INTR_DURATION(ether->sched, RX_DURATION));
     } else {
-        ether->rx_intr_cycle = -1;
-    }
-
-    return TRUE;
-}
-
-int ethernet_interrupt(struct ethernet *ether)
-{
-    int has_tx, has_rx;
-
-    has_tx = (ether->intr_cycle == ether->tx_intr_cycle);
-    has_rx = (ether->intr_cycle == ether->rx_intr_cycle);
-
-    if (has_tx) {
-        if (unlikely(!tx_interrupt(ether)))
-            return FALSE;
-    }
-    if (has_rx) {
-        if (unlikely(!rx_interrupt(ether)))
-            return FALSE;
+        intr_cancel(ether->sched, ether->rx_timer);
     }
 
-    if (unlikely(!update_intr_cycle(ether, ether->intr_cycle, TRUE))) {
-        report_error("ethernet: interrupt: "
-                     "could not update the interrupt cycle");
-        return FALSE;
-    }
     return TRUE;
 }
 
@@ -564,10 +513,23 @@ void ethernet_before_step(struct ethernet *ether)
 {
     if (ether->countdown_wakeup) {
         ether->countdown_wakeup = FALSE;
-        ether->pending &= ~(1 << TASK_ETHERNET);
+        INTR_BLOCK(ether->sched, TASK_ETHERNET);
     }
 }
 
+/* Obtains the cycle of the next interrupt of the ethernet controller.
+ * Returns the cycle (or a negative value if none is scheduled).
+ */
+static
+int64_t get_intr_cycle(const struct ethernet *ether)
+{
+    unsigned int ids[2];
+
+    ids[0] = ether->tx_timer;
+    ids[1] = ether->rx_timer;
+    return intr_earliest_cycle(ether->sched, 2, ids);
+}
+
 void ethernet_print_registers(const struct ethernet *ether,
                               struct decoder *dec)
 {
@@ -605,15 +567,15 @@ void ethernet_print_registers(const struct ethernet *ether,
                         DECODE_VALUE, ether->address);
     decode_tagged_value(dec->vdec, "CT_WAKEUP",
                         DECODE_BOOL, ether->countdown_wakeup);
-    decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE, ether->pending);
-    decode_tagged_value(dec->vdec, "ICYC",
-                        DECODE_SVALUE32, ether->intr_cycle);
+    decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE,
+                        ether->sched->pending & (1 << TASK_ETHERNET));
+    decode_tagged_cycle(dec->vdec, "ICYC", get_intr_cycle(ether));
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "TX_ICYC",
-                        DECODE_SVALUE32, ether->tx_intr_cycle);
-    decode_tagged_value(dec->vdec, "RX_ICYC",
-                        DECODE_SVALUE32, ether->rx_intr_cycle);
+    decode_tagged_cycle(dec->vdec, "TX_ICYC",
+                        intr_timer_cycle(ether->sched, ether->tx_timer));
+    decode_tagged_cycle(dec->vdec, "RX_ICYC",
+                        intr_timer_cycle(ether->sched, ether->rx_timer));
     string_buffer_print(output, "\n");
 }
 
@@ -635,10 +597,10 @@ void ethernet_serialize(const struct ethernet *ether, struct serdes *sd)
     serdes_put16(sd, ether->status);
     serdes_put_bool(sd, ether->countdown_wakeup);
     serdes_put_bool(sd, ether->end_tx);
-    serdes_put32(sd, ether->intr_cycle);
-    serdes_put32(sd, ether->tx_intr_cycle);
-    serdes_put32(sd, ether->rx_intr_cycle);
-    serdes_put16(sd, ether->pending);
+    serdes_put64(sd, get_intr_cycle(ether));
+    serdes_put64(sd, intr_timer_cycle(ether->sched, ether->tx_timer));
+    serdes_put64(sd, intr_timer_cycle(ether->sched, ether->rx_timer));
+    serdes_put16(sd, ether->sched->pending & (1 << TASK_ETHERNET));
 }
 
 void ethernet_deserialize(struct ethernet *ether, struct serdes *sd)
@@ -659,8 +621,10 @@ void ethernet_deserialize(struct ethernet *ether, struct serdes *sd)
     ether->status = serdes_get16(sd);
     ether->countdown_wakeup = serdes_get_bool(sd);
     ether->end_tx = serdes_get_bool(sd);
-    ether->intr_cycle = serdes_get32(sd);
-    ether->tx_intr_cycle = serdes_get32(sd);
-    ether->rx_intr_cycle = serdes_get32(sd);
-    ether->pending = serdes_get16(sd);
+    serdes_get64(sd); /* The next interrupt cycle (not needed). */
+    intr_schedule(ether->sched, ether->tx_timer,
+                  (int64_t) serdes_get64(sd));
+    intr_schedule(ether->sched, ether->rx_timer,
+                  (int64_t) serdes_get64(sd));
+    ether->sched->pending |= serdes_get16(sd) & (1 << TASK_ETHERNET);
 }
@@ -4,6 +4,7 @@
 
 #include <stdint.h>
 
+#include "simulator/intr.h"
 #include "microcode/microcode.h"
 #include "common/serdes.h"
 #include "common/string_buffer.h"
@@ -82,10 +83,9 @@ struct ethernet {
                                    */
     int end_tx;                   /* To end the current transmission. */
 
-    int32_t intr_cycle;           /* Cycle of the next interrupt. */
-    int32_t tx_intr_cycle;        /* Cycle of the next transmission. */
-    int32_t rx_intr_cycle;        /* Cycle of the next receive. */
-    uint16_t pending;             /* The task pending mask. */
+    struct intr_scheduler *sched; /* The event scheduler. */
+    unsigned int tx_timer;        /* Transmission timer. */
+    unsigned int rx_timer;        /* Receive timer. */
 };
 
 /* Functions. */
@@ -104,9 +104,11 @@ void ethernet_destroy(struct ethernet *ether);
 
 /* Creates a new ethernet object.
  * This obeys the initvar / destroy / create protocol.
+ * The timers of the ethernet controller are registered in the event
+ * scheduler `sched`.
  * Returns TRUE on success.
  */
-int ethernet_create(struct ethernet *ether);
+int ethernet_create(struct ethernet *ether, struct intr_scheduler *sched);
 
 /* Sets the transport object.
  * The transport object is given by `trp`.
@@ -156,7 +158,7 @@ void ethernet_ewfct(struct ethernet *ether);
  * simulation cycle is given by the parameter `cycle`.
  * Returns TRUE on success.
  */
-int ethernet_eodfct(struct ethernet *ether, uint16_t bus, int32_t cycle);
+int ethernet_eodfct(struct ethernet *ether, uint16_t bus, int64_t cycle);
 
 /* Performs the F2_ETH_EOSFCT (Ethernet Output Start Function). */
 void ethernet_eosfct(struct ethernet *ether);
@@ -171,7 +173,7 @@ uint16_t ethernet_erbfct(struct ethernet *ether);
  * The current simulation cycle is given by the parameter `cycle`.
  * Returns TRUE on success.
  */
-int ethernet_eefct(struct ethernet *ether, int32_t cycle);
+int ethernet_eefct(struct ethernet *ether, int64_t cycle);
 
 /* Performs the F2_ETH_EBFCT (Ethernet Branch Function).
  * Returns the bits to be modified in the NEXT part of the following
@@ -189,18 +191,13 @@ uint16_t ethernet_ecbfct(struct ethernet *ether);
  * The current cycle number is given by the parameter `cycle`.
  * Returns TRUE on success.
  */
-int ethernet_eisfct(struct ethernet *ether, int32_t cycle);
+int ethernet_eisfct(struct ethernet *ether, int64_t cycle);
 
 /* Processes a BLOCK instruction.
  * The task to be blocked is in the parameter `task`.
  */
 void ethernet_block_task(struct ethernet *ether, uint8_t task);
 
-/* Processes the ethernet interrupts.
- * Returns TRUE on success.
- */
-int ethernet_interrupt(struct ethernet *ether);
-
 /* Runs this before every microinstruction. */
 void ethernet_before_step(struct ethernet *ether);
 
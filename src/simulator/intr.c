@@ -2,39 +2,249 @@
 #include <stdint.h>
 
 #include "simulator/intr.h"
+#include "microcode/microcode.h"
 #include "common/utils.h"
 
 /* Functions. */
 
-/* Computes the next interrupt cycle. */
-int compute_intr_cycle(int32_t cycle, int must_advance,
-                       int n, const int32_t *intr_cycles,
-                       int32_t *intr_cycle)
+void intr_initvar(struct intr_scheduler *sched)
 {
-    int32_t diff, tmp;
-    int i;
+    sched->num_timers = 0;
+    sched->heap_size = 0;
+}
 
-    diff = -1;
-    for (i = 0; i < n; i++) {
-        if (intr_cycles[i] >= 0) {
-            tmp = INTR_CYCLE(intr_cycles[i] - cycle);
-            /* Some error must have happened. */
-            if (unlikely(((tmp == 0) && must_advance)
-                         || (INTR_DIFF_NEG(tmp)))) {
-                report_error("intr: compute_intr_cycle: "
-                             "entry %d has value %d, cycle is %d",
-                             i, intr_cycles[i], cycle);
-                return FALSE;
-            }
-            diff = INTR_CYCLE(diff);
-            diff = MIN(diff, tmp);
+void intr_destroy(struct intr_scheduler *sched)
+{
+    sched->num_timers = 0;
+    sched->heap_size = 0;
+}
+
+int intr_create(struct intr_scheduler *sched)
+{
+    intr_initvar(sched);
+    sched->next_cycle = -1;
+    sched->pending = (1 << TASK_EMULATOR);
+    sched->clock_mult = 1;
+    return TRUE;
+}
+
+int intr_register(struct intr_scheduler *sched, const char *name,
+                  intr_callback cb, void *arg, unsigned int *id)
+{
+    struct intr_timer *timer;
+
+    if (unlikely(sched->num_timers == INTR_MAX_TIMERS)) {
+        report_error("intr: register: too many timers (%s)", name);
+        return FALSE;
+    }
+
+    *id = sched->num_timers++;
+    timer = &sched->timers[*id];
+    timer->name = name;
+    timer->cb = cb;
+    timer->arg = arg;
+    timer->cycle = -1;
+    timer->pos = 0;
+    timer->fired = FALSE;
+    return TRUE;
+}
+
+void intr_set_clock_mult(struct intr_scheduler *sched, unsigned int mult)
+{
+    if (mult == 0) mult = 1;
+    if (mult > INTR_MAX_CLOCK_MULT) mult = INTR_MAX_CLOCK_MULT;
+    sched->clock_mult = mult;
+}
+
+void intr_reset(struct intr_scheduler *sched)
+{
+    unsigned int id;
+
+    for (id = 0; id < sched->num_timers; id++) {
+        sched->timers[id].cycle = -1;
+        sched->timers[id].fired = FALSE;
+    }
+    sched->heap_size = 0;
+    sched->next_cycle = -1;
+    sched->pending = (1 << TASK_EMULATOR);
+}
+
+/* Compares two timers in the heap.
+ * The timers are ordered by their expiration cycle, and by their
+ * identifiers.
+ * Returns TRUE if timer `a` expires before timer `b`.
+ */
+static
+int is_before(const struct intr_scheduler *sched,
+              unsigned int a, unsigned int b)
+{
+    int64_t cycle_a, cycle_b;
+
+    cycle_a = sched->timers[a].cycle;
+    cycle_b = sched->timers[b].cycle;
+    if (cycle_a != cycle_b) return (cycle_a < cycle_b);
+    return (a < b);
+}
+
+/* Places the timer `id` at position `pos` of the heap. */
+static
+void heap_set(struct intr_scheduler *sched, unsigned int pos,
+              unsigned int id)
+{
+    sched->heap[pos] = id;
+    sched->timers[id].pos = pos;
+}
+
+/* Moves the timer at position `pos` of the heap up. */
+static
+void sift_up(struct intr_scheduler *sched, unsigned int pos)
+{
+    unsigned int id, parent;
+
+    id = sched->heap[pos];
+    while (pos > 0) {
+        parent = (pos - 1) / 2;
+        if (!is_before(sched, id, sched->heap[parent])) break;
+        heap_set(sched, pos, sched->heap[parent]);
+        pos = parent;
+    }
+    heap_set(sched, pos, id);
+}
+
+/* Moves the timer at position `pos` of the heap down. */
+static
+void sift_down(struct intr_scheduler *sched, unsigned int pos)
+{
+    unsigned int id, child;
+
+    id = sched->heap[pos];
+    while (TRUE) {
+        child = 2 * pos + 1;
+        if (child >= sched->heap_size) break;
+        if (child + 1 < sched->heap_size
+            && is_before(sched, sched->heap[child + 1],
+                         sched->heap[child])) {
+            child++;
         }
+        if (!is_before(sched, sched->heap[child], id)) break;
+        heap_set(sched, pos, sched->heap[child]);
+        pos = child;
     }
+    heap_set(sched, pos, id);
+}
+
+/* Removes the timer at position `pos` of the heap. */
+static
+void heap_remove(struct intr_scheduler *sched, unsigned int pos)
+{
+    unsigned int last;
+
+    last = sched->heap[--sched->heap_size];
+    if (pos == sched->heap_size) return;
+
+    heap_set(sched, pos, last);
+    sift_up(sched, pos);
+    sift_down(sched, sched->timers[last].pos);
+}
 
-    if (diff < 0) {
-        *intr_cycle = -1;
+/* Updates the cycle of the next timer to expire. */
+static
+void update_next_cycle(struct intr_scheduler *sched)
+{
+    if (sched->heap_size > 0) {
+        sched->next_cycle = sched->timers[sched->heap[0]].cycle;
     } else {
-        *intr_cycle = INTR_CYCLE(diff + cycle);
+        sched->next_cycle = -1;
+    }
+}
+
+void intr_schedule(struct intr_scheduler *sched, unsigned int id,
+                   int64_t cycle)
+{
+    struct intr_timer *timer;
+
+    timer = &sched->timers[id];
+    if (timer->cycle >= 0) {
+        heap_remove(sched, timer->pos);
+    }
+
+    /* An expired timer that is rescheduled (or cancelled) before its
+     * callback was invoked no longer fires.
+     */
+    timer->fired = FALSE;
+
+    timer->cycle = cycle;
+    if (cycle >= 0) {
+        heap_set(sched, sched->heap_size++, id);
+        sift_up(sched, timer->pos);
+    }
+    update_next_cycle(sched);
+}
+
+void intr_cancel(struct intr_scheduler *sched, unsigned int id)
+{
+    intr_schedule(sched, id, -1);
+}
+
+int64_t intr_timer_cycle(const struct intr_scheduler *sched,
+                         unsigned int id)
+{
+    return sched->timers[id].cycle;
+}
+
+int64_t intr_earliest_cycle(const struct intr_scheduler *sched,
+                            unsigned int n, const unsigned int *ids)
+{
+    int64_t cycle;
+    unsigned int i, best;
+
+    best = INTR_MAX_TIMERS;
+    for (i = 0; i < n; i++) {
+        if (sched->timers[ids[i]].cycle < 0) continue;
+        if (best == INTR_MAX_TIMERS || is_before(sched, ids[i], best))
+            best = ids[i];
+    }
+
+    cycle = (best == INTR_MAX_TIMERS) ? -1 : sched->timers[best].cycle;
+    return cycle;
+}
+
+int intr_dispatch(struct intr_scheduler *sched)
+{
+    unsigned int expired[INTR_MAX_TIMERS];
+    unsigned int i, n, id;
+    struct intr_timer *timer;
+    int64_t cycle;
+
+    cycle = sched->next_cycle;
+    if (cycle < 0) return TRUE;
+
+    /* Collect all the timers expiring now before invoking any callback,
+     * since the callbacks may reschedule the other expired timers.
+     * They come out of the heap in the order of registration. A callback
+     * that reschedules or cancels one of the timers not yet invoked
+     * clears its `fired` flag, so that it is skipped.
+     */
+    n = 0;
+    while (sched->heap_size > 0) {
+        id = sched->heap[0];
+        if (sched->timers[id].cycle != cycle) break;
+        heap_remove(sched, 0);
+        sched->timers[id].cycle = -1;
+        sched->timers[id].fired = TRUE;
+        expired[n++] = id;
+    }
+    update_next_cycle(sched);
+
+    for (i = 0; i < n; i++) {
+        timer = &sched->timers[expired[i]];
+        if (!timer->fired) continue;
+        timer->fired = FALSE;
+        if (unlikely(!(*timer->cb)(timer->arg, cycle))) {
+            report_error("intr: dispatch: "
+                         "could not process timer `%s`", timer->name);
+            return FALSE;
+        }
     }
 
     return TRUE;
@@ -4,30 +4,146 @@
 
 #include <stdint.h>
 
-/* Macros. */
-#define INTR_CYCLE(x) ((x) & 0x7FFFFFFF)
-#define INTR_DIFF_NEG(x) ((x) & 0x40000000)
+/* Constants. */
+#define INTR_MAX_TIMERS                   16
+#define INTR_MAX_CLOCK_MULT               64
+
+/* Macros to manipulate the wakeup register of the scheduler. */
+#define INTR_WAKEUP(sched, task) \
+    ((sched)->pending |= (uint16_t) (1U << (task)))
+#define INTR_BLOCK(sched, task) \
+    ((sched)->pending &= (uint16_t) ~(1U << (task)))
+#define INTR_IS_PENDING(sched, task) \
+    (((sched)->pending >> (task)) & 1)
+
+/* Converts the duration `d` of a device event (in cycles of the standard
+ * clock) to cycles of the cpu (which may run faster than the devices).
+ */
+#define INTR_DURATION(sched, d) \
+    (((int64_t) (d)) * (sched)->clock_mult)
+
+/* Obtains the highest priority task with a pending wakeup. Since the
+ * emulator task (task 0) is always pending, the mask is never zero.
+ */
+#define INTR_NEXT_TASK(sched) \
+    ((uint8_t) (31 - __builtin_clz((unsigned int) (sched)->pending)))
+
+/* Data structures and types. */
+
+/* Callback invoked when a timer expires.
+ * The parameter `arg` is the argument given when the timer was
+ * registered, and `cycle` is the cycle when the timer expired.
+ * Returns TRUE on success.
+ */
+typedef int (*intr_callback)(void *arg, int64_t cycle);
+
+/* A timer of the event scheduler. */
+struct intr_timer {
+    const char *name;             /* The name of the timer. */
+    intr_callback cb;             /* The callback to invoke. */
+    void *arg;                    /* The argument for the callback. */
+    int64_t cycle;                /* The cycle when the timer expires
+                                   * (negative if not scheduled).
+                                   */
+    unsigned int pos;             /* The position in the heap. */
+    int fired;                    /* The timer expired and its callback
+                                   * is still due (in intr_dispatch()).
+                                   */
+};
+
+/* The event scheduler (a min-heap of timers).
+ * The fields checked in every cycle come first.
+ */
+struct intr_scheduler {
+    int64_t next_cycle;           /* The cycle of the next timer to expire
+                                   * (negative if none is scheduled).
+                                   */
+    uint16_t pending;             /* The wakeup register (the bitset of
+                                   * the tasks ready to run).
+                                   */
+    unsigned int clock_mult;      /* The cpu clock multiplier (the
+                                   * durations of the device events are
+                                   * scaled by it).
+                                   */
+    struct intr_timer timers[INTR_MAX_TIMERS]; /* The registered timers. */
+    unsigned int num_timers;      /* The number of registered timers. */
+    unsigned int heap[INTR_MAX_TIMERS]; /* The scheduled timers. */
+    unsigned int heap_size;       /* Number of scheduled timers. */
+};
 
 /* Functions. */
 
-/* Computes the next interrupt cycle.
- * The `cycle` parameters specifies the current cycle. The `must_advance`
- * is for validation. This is to ensure that the resulting output
- * (the next interrupt cycle) is after the current cycle in `cycle`.
- * The `n` parameter specifies the length of the array `intr_cycles`.
- * The array `intr_cycles` specifies the possible interrupt cycles and
- * the result of this function is the most imminent interrupt cycle
- * among all the valid values (i.e., non-negative) in this array.
- * The monst imminent interrupt cycle is the one closest to `cycle`.
- * A negative value in `intr_cycles` means to ignore the value.
- * When all the values in `intr_cycles` are negative, the resulting
- * value is negative as well. The output of the function, i.e., the
- * next interrupt cycle is returned via the parameter `intr_cycle`.
- * Returns TRUE if the computation was successful.
- */
-int compute_intr_cycle(int32_t cycle, int must_advance,
-                       int n, const int32_t *intr_cycles,
-                       int32_t *intr_cycle);
+/* Initializes the scheduler variable.
+ * Note that this does not create the object yet.
+ * This obeys the initvar / destroy / create protocol.
+ */
+void intr_initvar(struct intr_scheduler *sched);
+
+/* Destroys the scheduler object
+ * (and releases all the used resources).
+ * This obeys the initvar / destroy / create protocol.
+ */
+void intr_destroy(struct intr_scheduler *sched);
+
+/* Creates a new scheduler object (without any timers).
+ * This obeys the initvar / destroy / create protocol.
+ * Returns TRUE on success.
+ */
+int intr_create(struct intr_scheduler *sched);
+
+/* Registers a new timer.
+ * The name of the timer is given by `name`, and the callback to invoke
+ * when the timer expires is `cb` (with argument `arg`). The timer is
+ * not scheduled initially. The identifier of the timer is returned
+ * in `id`. Timers expiring at the same cycle are dispatched in the
+ * order they were registered.
+ * Returns TRUE on success.
+ */
+int intr_register(struct intr_scheduler *sched, const char *name,
+                  intr_callback cb, void *arg, unsigned int *id);
+
+/* Sets the cpu clock multiplier to `mult`.
+ * The cpu runs `mult` times faster than the devices, so that the
+ * events scheduled from now on last `mult` times as many cycles (see
+ * INTR_DURATION()). The timers already scheduled are not changed.
+ * The multiplier is limited to INTR_MAX_CLOCK_MULT.
+ */
+void intr_set_clock_mult(struct intr_scheduler *sched, unsigned int mult);
+
+/* Cancels all timers and clears the wakeup register (except for the
+ * emulator task, which is always ready to run).
+ */
+void intr_reset(struct intr_scheduler *sched);
+
+/* Schedules the timer `id` to expire at `cycle`.
+ * If the timer was already scheduled, it is rescheduled. If `cycle` is
+ * negative, the timer is canceled.
+ */
+void intr_schedule(struct intr_scheduler *sched, unsigned int id,
+                   int64_t cycle);
+
+/* Cancels the timer `id`. */
+void intr_cancel(struct intr_scheduler *sched, unsigned int id);
+
+/* Obtains the cycle when the timer `id` expires.
+ * Returns the cycle (or a negative value if not scheduled).
+ */
+int64_t intr_timer_cycle(const struct intr_scheduler *sched,
+                         unsigned int id);
+
+/* Obtains the most imminent expiration cycle among a set of timers.
+ * The timers are given in the array `ids` of length `n`.
+ * Returns the cycle (or a negative value if none is scheduled).
+ */
+int64_t intr_earliest_cycle(const struct intr_scheduler *sched,
+                            unsigned int n, const unsigned int *ids);
+
+/* Dispatches all timers expiring at the cycle `sched->next_cycle`.
+ * The timers that a callback reschedules or cancels before their own
+ * callbacks are invoked are skipped.
+ * Returns TRUE on success.
+ */
+int intr_dispatch(struct intr_scheduler *sched);
 
 
 #endif /* __SIMULATOR_INTR_H */
@@ -6,6 +6,8 @@
 
 #include "simulator/simulator.h"
 #include "simulator/intr.h"
+#include "simulator/bitblt.h"
+#include "simulator/blkcache.h"
 #include "microcode/microcode.h"
 #include "microcode/nova.h"
 #include "simulator/rom.h"
@@ -18,32 +20,249 @@
 #define MEMORY_TOP                    0xFE00
 #define XM_BANK_START                 0xFFE0
 #define XM_BANK_END (XM_BANK_START + TASK_NUM_TASKS)
+#define IO_MAP_SIZE          (MEMORY_SIZE - MEMORY_TOP)
+
+/* The devices of the memory mapped I/O addresses. */
+#define IO_NONE                            0
+#define IO_MOUSE                           1
+#define IO_KEYBOARD                        2
+#define IO_XM_BANK                         3
 
 /* For fixing the microcode in RAM. */
 #define MC_INVERT_MASK            0x00088400
 
+/* Marks an invalid entry in the predecoded microcode cache. */
+#define MC_CACHE_INVALID                0xFF
+
+/* Entries of the predecoded microcode cache per microcode address, so
+ * that the microcode shared by two tasks keeps one entry for each.
+ */
+#define MC_CACHE_WAYS                      2
+
+/* Number of consecutive display fields the emulator must spend in the
+ * same idle loop to be reported as idle by simulator_is_idle().
+ */
+#define IDLE_FIELDS                        2
+
+/* Number of nova instructions without going back to the loop head
+ * before another backward jump is taken as the new loop head (when
+ * checking for idle display fields).
+ */
+#define IDLE_LOOP_LENGTH                 512
+
+/* For the native BITBLT. */
+#define NOVA_BITBLT                   0x6214 /* BITBLT (061024). */
+#define NOVA_JMP_SELF                 0x0100 /* JMP .+0 (000400). */
+#define BITBLT_CHUNK_WORDS              1024 /* Maximum number of words
+                                              * processed natively per
+                                              * instruction.
+                                              */
+#define BITBLT_LINE_CYCLES                50 /* Approximate cost of the
+                                              * microcode per scanline.
+                                              */
+
+/* For the native nova instructions. */
+#define NOVA_START_MPC                0x0010 /* START (00020), the head of
+                                              * the emulator main loop.
+                                              */
+
+/* For the native disk transfers. */
+#define DISK_WORD_LOOP_MPC            0x03E5 /* The head of the loop of the
+                                              * disk word task that reads
+                                              * or writes the words of a
+                                              * record (01745).
+                                              */
+
 /* For memory access. */
 #define MA_EXTENDED                        1
 #define MA_WORD_BIT                        2
 
-/* The state size when serializing. */
-#define STATE_SIZE                    542419
+/* The state file format. */
+#define STATE_MAGIC               0x50414C4FU /* "PALO" */
+#define STATE_VERSION                      4  /* BITBLT stall. */
+#define STATE_SIZE                    542549
+
+/* For the arena of the simulator state. */
+#define ARENA_ALIGN                       64 /* The cache line size. */
+
+/* Data structures and types. */
+
+/* Approximate cost of the BITBLT microcode per word, for each source
+ * type (measured over random operations with the standard microcode).
+ */
+static const uint8_t BITBLT_WORD_CYCLES[4] = { 39, 45, 55, 20 };
+
+/* The bank transitions performed by SWMODE. The table is indexed by the
+ * system type, the current bank, and the bits 0x100 and 0x80 of the
+ * address of the next microinstruction (in this order).
+ */
+static const uint8_t SWMODE_BANKS[][NUM_MICROCODE_BANKS][4] = {
+    /* ALTO_I: ROM0 <-> RAM0. */
+    { { 1, 1, 1, 1 }, { 0, 0, 0, 0 }, { 3, 3, 3, 3 }, { 2, 2, 2, 2 } },
+    /* ALTO_II_1KROM: ROM0 <-> RAM0. */
+    { { 1, 1, 1, 1 }, { 0, 0, 0, 0 }, { 3, 3, 3, 3 }, { 2, 2, 2, 2 } },
+    /* ALTO_II_2KROM: ROM0 -> ROM1 or RAM0, ROM1 -> RAM0 or ROM0,
+     * RAM0 -> ROM1 or ROM0.
+     */
+    { { 2, 2, 1, 1 }, { 0, 0, 2, 2 }, { 0, 0, 1, 1 }, { 3, 3, 3, 3 } },
+    /* ALTO_II_3KRAM: ROM0 -> RAM0, RAM1 or RAM2, RAM0 -> RAM1, RAM2
+     * or ROM0, RAM1 -> RAM0, RAM2 or ROM0, RAM2 -> RAM0, RAM1 or ROM0.
+     */
+    { { 1, 3, 2, 1 }, { 0, 3, 2, 2 }, { 0, 3, 1, 1 }, { 0, 2, 1, 1 } },
+};
+
+/* The state of the simulator at the head of a loop in the emulator
+ * task. If the state is the same in two consecutive iterations, the
+ * emulator is idle (see skip_idle_loop()). The cycle counters are not
+ * part of it.
+ */
+struct loop_head {
+    uint16_t r[NUM_R_REGISTERS];  /* The R registers. */
+    uint16_t t, l, m;             /* The T, L and M registers. */
+    uint16_t mar, ir;             /* The MAR and IR registers. */
+    uint32_t mir;                 /* The MIR register. */
+    uint16_t mpc, emu_mpc;        /* The MPC and the emulator task MPC. */
+    uint16_t rmr, cram_addr;      /* Reset mode and control RAM address. */
+    uint16_t xm_bank;             /* The memory bank of the emulator. */
+    uint8_t srb;                  /* The S register bank of the emulator. */
+    uint8_t ctask, ntask;         /* The current and next task. */
+    uint8_t mem_task;             /* The task accessing memory. */
+    uint16_t mem_cycle;           /* The current memory cycle. */
+    uint16_t mem_low, mem_high;   /* The latched memory values. */
+    uint16_t mem_status;          /* The status of the memory operation. */
+    int task_switch;              /* If a task switch just happened. */
+    int aluC0, skip, carry;       /* The ALU carry, skip and carry flags. */
+    int rdram, wrtram;            /* Pending RDRAM and WRTRAM. */
+    int soft_reset;               /* Pending soft reset. */
+    int64_t intr_cycle;           /* The next interrupt cycle. */
+    uint32_t side_effects;        /* The side effects counter. */
+};
+
+/* The state of the nova program at the head of a loop. */
+struct nova_loop {
+    uint16_t pc;                  /* The nova PC. */
+    uint16_t ac[4];               /* The accumulators (R0 to R3). */
+    int carry;                    /* The nova carry. */
+    uint32_t mem_changes;         /* The memory changes counter. */
+};
+
+/* The timing of a nova instruction executed natively. It follows
+ * the simulator and memory cycles of the microcode steps that would
+ * execute the instruction.
+ */
+struct nova_timing {
+    int64_t cycles;               /* The cycles spent so far. */
+    int64_t task_cycles;          /* The cycles spent before the last
+                                   * microinstruction with TASK.
+                                   */
+    uint16_t mem_cycle;           /* The current memory cycle. */
+};
+
+/* Structure used to detect idle loops in the emulator task. */
+struct idle_detector {
+    uint32_t ir_loads;            /* The IR loads at the last check. */
+    uint16_t last_pc;             /* The nova PC at the last check. */
+    uint16_t head_pc;             /* The nova PC at the head of the loop. */
+    int valid;                    /* If the `head` is valid. */
+    int64_t cycle;                /* The cycle when `head` was saved. */
+    struct loop_head head;        /* The state at the head of the loop. */
+
+    /* The following is used to check if the emulator is idle for whole
+     * display fields. Unlike the above, it only looks at the nova state,
+     * and it survives the other tasks running.
+     */
+    struct nova_loop nova;        /* The nova state at the loop head. */
+    uint32_t nova_loads;          /* The IR loads when the loop head was
+                                   * last visited.
+                                   */
+    int idle;                     /* If the last loop iteration was idle. */
+    int field_valid;              /* If the `field_nova` is valid. */
+    struct nova_loop field_nova;  /* The nova loop at the end of the
+                                   * previous field.
+                                   */
+    uint32_t field_polls;         /* The input polls at the end of the
+                                   * previous field.
+                                   */
+    unsigned int idle_fields;     /* Consecutive display fields that ended
+                                   * with the emulator idle in the same
+                                   * loop.
+                                   */
+};
+
+/* The arrays of the simulator state, allocated together in one block
+ * aligned to the cache line. The arrays used in every cycle come first,
+ * then the predecoded microcode (read in every step), and the structures
+ * used by the fast paths come last.
+ */
+struct sim_arena {
+    uint16_t r[NUM_R_REGISTERS];  /* R register file. */
+    uint16_t task_mpc[TASK_NUM_TASKS]; /* The MPC of each task. */
+    uint16_t xm_banks[TASK_NUM_TASKS]; /* The XM bank registers. */
+    uint16_t *mem_base[TASK_NUM_TASKS]; /* Normal memory banks. */
+    uint16_t *xmem_base[TASK_NUM_TASKS]; /* Extended memory banks. */
+    int64_t task_cycle[TASK_NUM_TASKS]; /* The cycles of each task. */
+    uint8_t sreg_banks[TASK_NUM_TASKS]; /* S register banks. */
+    uint16_t s[NUM_S_BANKS * NUM_S_REGISTERS]; /* S register file. */
+    uint16_t consts[CONSTANT_SIZE]; /* Constant ROM. */
+    uint8_t acs_rom[ACSROM_SIZE]; /* The ACSROM. */
+    uint8_t io_map[IO_MAP_SIZE];  /* Memory mapped I/O devices. */
+    struct mc_entry mc_cache[NUM_MICROCODE_BANKS * MICROCODE_SIZE
+                             * MC_CACHE_WAYS];
+                                  /* Predecoded microcode. */
+    uint32_t microcode[NUM_MICROCODE_BANKS * MICROCODE_SIZE];
+                                  /* Microcode ROM + RAM. */
+    uint16_t mem[NUM_MEMORY_BANKS * MEMORY_SIZE]; /* Main memory. */
+    struct idle_detector idl;     /* State of the idle loop detection. */
+    struct bitblt bb;             /* The native BITBLT operation. */
+};
+
+/* Static function declarations. */
+static void step_alto_i(struct simulator *sim);
+static void step_alto_ii_1krom(struct simulator *sim);
+static void step_alto_ii_2krom(struct simulator *sim);
+static void step_alto_ii_3kram(struct simulator *sim);
 
 /* Functions. */
 
+/* Invalidates entries of the predecoded microcode cache.
+ * The entries from `start` up to (but not including) `end`
+ * are invalidated.
+ */
+static
+void invalidate_mc_cache(struct simulator *sim, uint16_t start, uint16_t end)
+{
+    unsigned int addr, way;
+
+    for (addr = start; addr < end; addr++) {
+        for (way = 0; way < MC_CACHE_WAYS; way++) {
+            sim->mc_cache[MC_CACHE_WAYS * addr + way].mc.task =
+                MC_CACHE_INVALID;
+        }
+    }
+}
+
 void simulator_initvar(struct simulator *sim)
 {
+    sim->arena = NULL;
     sim->r = NULL;
     sim->s = NULL;
     sim->acs_rom = NULL;
     sim->consts = NULL;
     sim->microcode = NULL;
+    sim->mc_cache = NULL;
+    sim->idl = NULL;
+    sim->bb = NULL;
     sim->task_mpc = NULL;
     sim->task_cycle = NULL;
     sim->mem = NULL;
     sim->xm_banks = NULL;
+    sim->mem_base = NULL;
+    sim->xmem_base = NULL;
+    sim->io_map = NULL;
     sim->sreg_banks = NULL;
 
+    blkcache_initvar(&sim->bc);
+    intr_initvar(&sim->sched);
     disk_initvar(&sim->dsk);
     display_initvar(&sim->displ);
     ethernet_initvar(&sim->ether);
@@ -58,70 +277,138 @@ void simulator_destroy(struct simulator *sim)
     ethernet_destroy(&sim->ether);
     keyboard_destroy(&sim->keyb);
     mouse_destroy(&sim->mous);
+    intr_destroy(&sim->sched);
+    blkcache_destroy(&sim->bc);
 
-    if (sim->r) free((void *) sim->r);
+    /* The arrays in the arena are released together. */
+    if (sim->arena) free(sim->arena);
+    sim->arena = NULL;
     sim->r = NULL;
-
-    if (sim->s) free((void *) sim->s);
     sim->s = NULL;
-
-    if (sim->acs_rom) free((void *) sim->acs_rom);
     sim->acs_rom = NULL;
-
-    if (sim->consts) free((void *) sim->consts);
     sim->consts = NULL;
-
-    if (sim->microcode) free((void *) sim->microcode);
     sim->microcode = NULL;
-
-    if (sim->task_mpc) free((void *) sim->task_mpc);
     sim->task_mpc = NULL;
-
-    if (sim->task_cycle) free((void *) sim->task_cycle);
     sim->task_cycle = NULL;
-
-    if (sim->mem) free((void *) sim->mem);
     sim->mem = NULL;
-
-    if (sim->xm_banks) free((void *) sim->xm_banks);
     sim->xm_banks = NULL;
-
-    if (sim->sreg_banks) free((void *) sim->sreg_banks);
+    sim->mem_base = NULL;
+    sim->xmem_base = NULL;
+    sim->io_map = NULL;
     sim->sreg_banks = NULL;
+    sim->mc_cache = NULL;
+    sim->idl = NULL;
+    sim->bb = NULL;
+
+}
+
+/* Initializes the map of the memory mapped I/O addresses `io_map`. */
+static
+void init_io_map(uint8_t *io_map)
+{
+    uint32_t address;
+    uint8_t dev;
+
+    for (address = MEMORY_TOP; address < MEMORY_SIZE; address++) {
+        if (address >= MOUSE_BASE && address < MOUSE_END) {
+            dev = IO_MOUSE;
+        } else if (address >= KEYBOARD_BASE && address < KEYBOARD_END) {
+            dev = IO_KEYBOARD;
+        } else if (address >= XM_BANK_START && address < XM_BANK_END) {
+            dev = IO_XM_BANK;
+        } else {
+            dev = IO_NONE;
+        }
+        io_map[address - MEMORY_TOP] = dev;
+    }
+}
+
+/* Updates the normal and extended memory banks of task `task`
+ * (when its XM bank register changes).
+ */
+static
+void update_mem_base(struct simulator *sim, uint8_t task)
+{
+    uint16_t banks;
+
+    banks = sim->xm_banks[task];
+    sim->mem_base[task] = &sim->mem[((banks >> 2) & 0x3) * MEMORY_SIZE];
+    sim->xmem_base[task] = &sim->mem[(banks & 0x3) * MEMORY_SIZE];
+}
+
+/* Updates the memory banks of all tasks. */
+static
+void update_mem_bases(struct simulator *sim)
+{
+    uint8_t task;
+
+    for (task = 0; task < TASK_NUM_TASKS; task++) {
+        update_mem_base(sim, task);
+    }
+}
+
+/* Allocates the arena of the simulator state, and points the arrays
+ * of the state into it.
+ * Returns TRUE on success.
+ */
+static
+int alloc_arena(struct simulator *sim)
+{
+    struct sim_arena *a;
+    uintptr_t addr;
+
+    sim->arena = malloc(sizeof(struct sim_arena) + ARENA_ALIGN - 1);
+    if (unlikely(!sim->arena)) return FALSE;
+
+    addr = (uintptr_t) sim->arena;
+    addr = (addr + ARENA_ALIGN - 1) & ~((uintptr_t) (ARENA_ALIGN - 1));
+    a = (struct sim_arena *) addr;
+
+    sim->r = a->r;
+    sim->task_mpc = a->task_mpc;
+    sim->xm_banks = a->xm_banks;
+    sim->mem_base = a->mem_base;
+    sim->xmem_base = a->xmem_base;
+    sim->task_cycle = a->task_cycle;
+    sim->sreg_banks = a->sreg_banks;
+    sim->s = a->s;
+    sim->consts = a->consts;
+    sim->acs_rom = a->acs_rom;
+    sim->io_map = a->io_map;
+    sim->mc_cache = a->mc_cache;
+    sim->microcode = a->microcode;
+    sim->mem = a->mem;
+    sim->idl = &a->idl;
+    sim->bb = &a->bb;
+    return TRUE;
+}
+
+/* Selects the simulation step specialized for the system type
+ * of the simulator.
+ */
+static
+void select_step(struct simulator *sim)
+{
+    switch (sim->sys_type) {
+    case ALTO_I: sim->step = &step_alto_i; break;
+    case ALTO_II_1KROM: sim->step = &step_alto_ii_1krom; break;
+    case ALTO_II_2KROM: sim->step = &step_alto_ii_2krom; break;
+    case ALTO_II_3KRAM: sim->step = &step_alto_ii_3kram; break;
+    }
 }
 
 int simulator_create(struct simulator *sim, enum system_type sys_type)
 {
     simulator_initvar(sim);
 
-    sim->r = malloc(NUM_R_REGISTERS * sizeof(uint16_t));
-    sim->s = malloc(NUM_S_BANKS * NUM_S_REGISTERS * sizeof(uint16_t));
-    sim->acs_rom = (uint8_t *)
-        malloc(ACSROM_SIZE * sizeof(uint8_t));
-    sim->consts = (uint16_t *)
-        malloc(CONSTANT_SIZE * sizeof(uint16_t));
-    sim->microcode = (uint32_t *)
-        malloc(NUM_MICROCODE_BANKS * MICROCODE_SIZE * sizeof(uint32_t));
-    sim->task_mpc = (uint16_t *)
-        malloc(TASK_NUM_TASKS * sizeof(uint16_t));
-    sim->task_cycle = (int32_t *)
-        malloc(TASK_NUM_TASKS * sizeof(int32_t));
-    sim->mem = (uint16_t *)
-        malloc(NUM_MEMORY_BANKS * MEMORY_SIZE * sizeof(uint16_t));
-    sim->xm_banks = (uint16_t *)
-        malloc(TASK_NUM_TASKS * sizeof(uint16_t));
-    sim->sreg_banks = (uint8_t *)
-        malloc(TASK_NUM_TASKS * sizeof(uint8_t));
-
-    if (unlikely(!sim->r || !sim->s
-                 || !sim->acs_rom || !sim->consts || !sim->microcode
-                 || !sim->task_mpc || !sim->task_cycle
-                 || !sim->mem || !sim->xm_banks
-                 || !sim->sreg_banks)) {
+    if (unlikely(!alloc_arena(sim))) {
         report_error("sim: create: could not allocate memory");
         simulator_destroy(sim);
         return FALSE;
     }
+    init_io_map(sim->io_map);
+    memset(sim->xm_banks, 0, TASK_NUM_TASKS * sizeof(uint16_t));
+    update_mem_bases(sim);
 
     /* Copy the ROMs into the simulator.
      * Note:  the constant ROM and the microcode ROM can be overwritten
@@ -142,19 +429,34 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
         }
     }
 
-    if (unlikely(!disk_create(&sim->dsk))) {
+    if (unlikely(!blkcache_create(&sim->bc))) {
+        report_error("sim: create: could not create block cache");
+        simulator_destroy(sim);
+        return FALSE;
+    }
+
+    if (unlikely(!intr_create(&sim->sched))) {
+        report_error("sim: create: could not create event scheduler");
+        simulator_destroy(sim);
+        return FALSE;
+    }
+
+    /* The timers are registered in this order, which is also the order
+     * in which the events of the same cycle are processed.
+     */
+    if (unlikely(!disk_create(&sim->dsk, &sim->sched))) {
         report_error("sim: create: could not create disk controller");
         simulator_destroy(sim);
         return FALSE;
     }
 
-    if (unlikely(!display_create(&sim->displ))) {
+    if (unlikely(!display_create(&sim->displ, &sim->sched))) {
         report_error("sim: create: could not create display controller");
         simulator_destroy(sim);
         return FALSE;
     }
 
-    if (unlikely(!ethernet_create(&sim->ether))) {
+    if (unlikely(!ethernet_create(&sim->ether, &sim->sched))) {
         report_error("sim: create: could not create ethernet controller");
         simulator_destroy(sim);
         return FALSE;
@@ -173,6 +475,14 @@ int simulator_create(struct simulator *sim, enum system_type sys_type)
     }
 
     sim->sys_type = sys_type;
+    select_step(sim);
+    sim->engine = SIM_ENGINE_THREADED;
+    sim->native_bitblt = FALSE;
+    sim->native_nova = FALSE;
+    sim->native_disk = FALSE;
+    sim->single_step = FALSE;
+    sim->std_rom = TRUE;
+    invalidate_mc_cache(sim, 0, NUM_MICROCODE_BANKS * MICROCODE_SIZE);
     return TRUE;
 }
 
@@ -248,44 +558,53 @@ int simulator_load_microcode_rom(struct simulator *sim,
     serdes_rewind(&sd);
     serdes_get32_array(&sd, &sim->microcode[offset], MICROCODE_SIZE);
     serdes_destroy(&sd);
+
+    invalidate_mc_cache(sim, offset, offset + MICROCODE_SIZE);
+    if (bank == 0) sim->std_rom = FALSE;
     return TRUE;
 }
 
-/* Updates the intr_cycle.
- * The parameter `must_advance` is passed to compute_intr_cycle().
- * Returns TRUE on success.
- */
-static
-int update_intr_cycle(struct simulator *sim, int must_advance)
+void simulator_set_engine(struct simulator *sim, enum sim_engine engine)
 {
-    int32_t intr_cycles[3];
-    int32_t cycle, diff;
+    sim->engine = engine;
 
-    intr_cycles[0] = sim->dsk.intr_cycle;
-    intr_cycles[1] = sim->displ.intr_cycle;
-    intr_cycles[2] = sim->ether.intr_cycle;
+    /* The handlers are bound when decoding, so decode everything again. */
+    invalidate_mc_cache(sim, 0, NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+}
 
-    /* If the current interrupt cycle is set, use the minimum
-     * between intr_cycle and cycle.
-     */
-    if (sim->intr_cycle >= 0) {
-        cycle = sim->intr_cycle;
-        diff = INTR_CYCLE(cycle - sim->cycle);
-        if (!INTR_DIFF_NEG(diff))
-            cycle = sim->cycle;
-    } else {
-        cycle = sim->cycle;
-    }
+void simulator_set_native_bitblt(struct simulator *sim, int enable)
+{
+    sim->native_bitblt = enable;
+}
 
-    if (unlikely(!compute_intr_cycle(cycle, must_advance,
-                                     3, intr_cycles,
-                                     &sim->intr_cycle))) {
-        report_error("simulator: update_intr_cycle: "
-                     "error in computing interrupt cycle");
-        sim->error = TRUE;
-        return FALSE;
-    }
-    return TRUE;
+void simulator_set_native_nova(struct simulator *sim, int enable)
+{
+    sim->native_nova = enable;
+}
+
+void simulator_set_native_disk(struct simulator *sim, int enable)
+{
+    sim->native_disk = enable;
+}
+
+void simulator_set_single_step(struct simulator *sim, int enable)
+{
+    sim->single_step = enable;
+}
+
+void simulator_set_fast_display(struct simulator *sim, int enable)
+{
+    display_set_fast(&sim->displ, enable);
+}
+
+void simulator_set_fast_disk(struct simulator *sim, int enable)
+{
+    disk_set_fast(&sim->dsk, enable);
+}
+
+void simulator_set_clock_mult(struct simulator *sim, unsigned int mult)
+{
+    intr_set_clock_mult(&sim->sched, mult);
 }
 
 void simulator_reset(struct simulator *sim)
@@ -295,7 +614,9 @@ void simulator_reset(struct simulator *sim)
     memset(sim->r, 0, NUM_R_REGISTERS * sizeof(uint16_t));
     memset(sim->s, 0, NUM_S_BANKS * NUM_S_REGISTERS * sizeof(uint16_t));
     memset(sim->mem, 0, NUM_MEMORY_BANKS * MEMORY_SIZE * sizeof(uint16_t));
+    blkcache_flush(&sim->bc);
     memset(sim->xm_banks, 0, TASK_NUM_TASKS * sizeof(uint16_t));
+    update_mem_bases(sim);
     memset(sim->sreg_banks, 0, TASK_NUM_TASKS * sizeof(uint8_t));
 
     for (task = 0; task < TASK_NUM_TASKS; task++) {
@@ -303,6 +624,7 @@ void simulator_reset(struct simulator *sim)
         sim->task_cycle[task] = 0;
     }
 
+    intr_reset(&sim->sched);
     disk_reset(&sim->dsk);
     display_reset(&sim->displ);
     if (unlikely(!ethernet_reset(&sim->ether))) {
@@ -344,76 +666,82 @@ void simulator_reset(struct simulator *sim)
     sim->mem_low = 0xFFFFU;
     sim->mem_high = 0xFFFFU;
     sim->mem_status = 0;
-
-    /* Sets the next interrupt cycle. */
-    sim->intr_cycle = 0;
-    update_intr_cycle(sim, TRUE);
+    sim->bitblt_stall = 0;
+
+    sim->ir_loads = 0;
+    sim->side_effects = 0;
+    sim->mem_changes = 0;
+    sim->input_polls = 0;
+    sim->idl->valid = FALSE;
+    sim->idl->nova.pc = 0xFFFF;
+    sim->idl->nova_loads = 0;
+    sim->idl->idle = FALSE;
+    sim->idl->field_valid = FALSE;
+    sim->idl->field_polls = 0;
+    sim->idl->idle_fields = 0;
 }
 
 uint16_t simulator_read(const struct simulator *sim, uint16_t address,
                         uint8_t task, int extended_memory)
 {
-    if (address >= MEMORY_TOP) {
-        if (address >= MOUSE_BASE && address < MOUSE_END) {
-            return mouse_read(&sim->mous, address);
-        }
-
-        if (address >= KEYBOARD_BASE && address < KEYBOARD_END) {
-            return keyboard_read(&sim->keyb, address);
-        }
+    const uint16_t *base_mem;
 
-        if (address >= XM_BANK_START && address < XM_BANK_END) {
-            /* NB: While not specified in documentation, some code (IFS in
-             * particular) relies on the fact that the upper 12 bits of the
-             * bank registers are all 1s.
-             */
-            return ((uint16_t) 0xFFF0)
-                | sim->xm_banks[address - XM_BANK_START];
-        }
-
-        /* Returns some garbage. */
-        return 0x0000;
-    } else {
-        const uint16_t *base_mem;
-        int bank_number;
-        bank_number = extended_memory
-            ? (sim->xm_banks[task] & 0x3)
-            : ((sim->xm_banks[task] >> 2) & 0x3);
-        base_mem = &sim->mem[bank_number * MEMORY_SIZE];
+    if (likely(address < MEMORY_TOP)) {
+        base_mem = (extended_memory)
+            ? sim->xmem_base[task] : sim->mem_base[task];
         return base_mem[address];
     }
+
+    switch (sim->io_map[address - MEMORY_TOP]) {
+    case IO_MOUSE:
+        return mouse_read(&sim->mous, address);
+    case IO_KEYBOARD:
+        return keyboard_read(&sim->keyb, address);
+    case IO_XM_BANK:
+        /* NB: While not specified in documentation, some code (IFS in
+         * particular) relies on the fact that the upper 12 bits of the
+         * bank registers are all 1s.
+         */
+        return ((uint16_t) 0xFFF0)
+            | sim->xm_banks[address - XM_BANK_START];
+    }
+
+    /* Returns some garbage. */
+    return 0x0000;
 }
 
 void simulator_write(struct simulator *sim, uint16_t address,
                      uint16_t data, uint8_t task, int extended_memory)
 {
-    if (address >= MEMORY_TOP) {
-        if (address >= MOUSE_BASE && address < MOUSE_END) {
-            /* Nothing to do here. */
-            return;
-        }
-
-        if (address >= KEYBOARD_BASE && address < KEYBOARD_END) {
-            /* Nothing to do here. */
-            return;
+    uint16_t *base_mem;
+    unsigned int bank_number;
+    uint8_t reg;
+
+    sim->side_effects++;
+    if (likely(address < MEMORY_TOP)) {
+        base_mem = (extended_memory)
+            ? sim->xmem_base[task] : sim->mem_base[task];
+        if (base_mem[address] != data) {
+            if (task == TASK_EMULATOR) sim->mem_changes++;
+            bank_number = (unsigned int)
+                ((base_mem - sim->mem) / MEMORY_SIZE);
+            BLKCACHE_WRITE(&sim->bc, bank_number, address);
         }
-
-        if (address >= XM_BANK_START && address < XM_BANK_END) {
-            /* NB: While not specified in documentation, some code (IFS in
-             * particular) relies on the fact that the upper 12 bits of the
-             * bank registers are all 1s.
-             */
-            sim->xm_banks[address - XM_BANK_START] = data;
-            return;
-        }
-    } else {
-        uint16_t *base_mem;
-        int bank_number;
-        bank_number = extended_memory
-            ? (sim->xm_banks[task] & 0x3)
-            : ((sim->xm_banks[task] >> 2) & 0x3);
-        base_mem = &sim->mem[bank_number * MEMORY_SIZE];
         base_mem[address] = data;
+        return;
+    }
+
+    /* Nothing to do for the mouse and the keyboard. */
+    if (sim->io_map[address - MEMORY_TOP] == IO_XM_BANK) {
+        /* NB: While not specified in documentation, some code (IFS in
+         * particular) relies on the fact that the upper 12 bits of the
+         * bank registers are all 1s.
+         */
+        reg = (uint8_t) (address - XM_BANK_START);
+        if (sim->xm_banks[reg] != data && task == TASK_EMULATOR)
+            sim->mem_changes++;
+        sim->xm_banks[reg] = data;
+        update_mem_base(sim, reg);
     }
 }
 
@@ -424,11 +752,9 @@ void update_cycles(struct simulator *sim)
     uint8_t task;
 
     sim->cycle++;
-    sim->cycle = INTR_CYCLE(sim->cycle);
 
     task = sim->ctask;
     sim->task_cycle[task]++;
-    sim->task_cycle[task] = INTR_CYCLE(sim->task_cycle[task]);
 
     /* Updates the memory cycle. */
     if (sim->mem_cycle != 0xFFFF) {
@@ -440,6 +766,40 @@ void update_cycles(struct simulator *sim)
     }
 }
 
+/* Advances the simulator and memory cycles by `num_cycles` cycles
+ * (same as calling update_cycles() `num_cycles` times). Any interrupt
+ * that happens within these cycles is dispatched at the correct cycle
+ * later by check_for_interrupts().
+ */
+static
+void advance_cycles(struct simulator *sim, uint32_t num_cycles)
+{
+    uint8_t task;
+
+    sim->cycle += num_cycles;
+
+    task = sim->ctask;
+    sim->task_cycle[task] += num_cycles;
+
+    /* Updates the memory cycle (it saturates after cycle 10). */
+    if (sim->mem_cycle != 0xFFFF) {
+        if (sim->mem_cycle + num_cycles > 10) {
+            sim->mem_cycle = 0xFFFF;
+        } else {
+            sim->mem_cycle += num_cycles;
+        }
+    }
+}
+
+/* Stalls until the memory cycle reaches `mem_cycle`. */
+static __inline__
+void wait_mem_cycle(struct simulator *sim, uint16_t mem_cycle)
+{
+    if (sim->mem_cycle < mem_cycle) {
+        advance_cycles(sim, mem_cycle - sim->mem_cycle);
+    }
+}
+
 /* Obtains the RSEL value (which can be modified by F2_EMU_ACSOURCE,
  * F2_EMU_ACDEST, and F2_EMU_LOAD_DNS).
  * The current predecoded microcode is in `mc`.
@@ -559,7 +919,151 @@ void do_wrtram(struct simulator *sim, uint16_t alu)
     mcode ^= MC_INVERT_MASK;
 
     sim->microcode[addr] = mcode;
+    invalidate_mc_cache(sim, addr, addr + 1);
     sim->wrtram = FALSE;
+    sim->side_effects++;
+}
+
+/* Reads the memory data (for BS_READ_MD).
+ * The flag `alto_i` tells whether this is an Alto I system. It is
+ * usually a constant, so that the inlined code is specialized for the
+ * system type.
+ * Returns the memory data.
+ */
+static __inline__
+uint16_t read_md(struct simulator *sim, int alto_i)
+{
+    uint16_t output;
+
+    /* Wait until cycle 5 to perform the read. */
+    wait_mem_cycle(sim, 5);
+
+    output = 0xFFFFU;
+    if (alto_i) {
+        if (sim->mem_cycle == 5) {
+            output = sim->mem_low;
+        } else if (sim->mem_cycle == 6) {
+            output = sim->mem_high;
+        } else {
+            report_error("simulator: step: "
+                         "unexpected read memory cycle");
+            sim->error = TRUE;
+            return 0;
+        }
+    } else {
+        /* Alto II. */
+        if (sim->mem_cycle >= 5) {
+            if (sim->mem_status & MA_WORD_BIT) {
+                output = sim->mem_high;
+            } else {
+                output = sim->mem_low;
+            }
+            sim->mem_status ^= MA_WORD_BIT;
+        }
+    }
+    return output;
+}
+
+/* Loads the memory address register (for F1_LOAD_MAR).
+ * The current predecoded microcode is in `mc`, and the value of the
+ * alu is in `alu`. The flag `alto_i` tells whether this is an Alto I
+ * system (as in read_md()).
+ */
+static __inline__
+void load_mar(struct simulator *sim, const struct microcode *mc,
+              uint16_t alu, int alto_i)
+{
+    uint16_t addr;
+    uint16_t min_cycles;
+
+    min_cycles = (alto_i) ? 7 : 5;
+    wait_mem_cycle(sim, min_cycles);
+    sim->mar = alu;
+    sim->mem_cycle = 1;
+    sim->mem_task = mc->task;
+    sim->mem_status = 0;
+    if (!alto_i && (mc->f2 == F2_STORE_MD)) {
+        sim->mem_status |= MA_EXTENDED;
+    }
+
+    /* Perform the reading now. */
+    addr = sim->mar;
+    if (unlikely(addr >= MOUSE_BASE && addr < KEYBOARD_END)) {
+        if (mc->task == TASK_EMULATOR) sim->input_polls++;
+    }
+    sim->mem_low = simulator_read(sim, addr, sim->mem_task,
+                                  sim->mem_status & MA_EXTENDED);
+
+    addr = (alto_i) ? (1 | addr) : (1 ^ addr);
+    sim->mem_high = simulator_read(sim, addr, sim->mem_task,
+                                   sim->mem_status & MA_EXTENDED);
+
+    /* For TASK_MEMORY_REFRESH, loading MAR with RSEL = 037 performs
+     * a BLOCK.
+     */
+    if (mc->task == TASK_MEMORY_REFRESH) {
+        if (alto_i && (mc->rsel == 037)) {
+            INTR_BLOCK(&sim->sched, mc->task);
+        }
+    }
+}
+
+/* Stores the memory data (for F2_STORE_MD).
+ * The current predecoded microcode is in `mc`, and the value of the
+ * bus is in `bus`. The flag `alto_i` tells whether this is an Alto I
+ * system (as in read_md()).
+ */
+static __inline__
+void store_md(struct simulator *sim, const struct microcode *mc,
+              uint16_t bus, int alto_i)
+{
+    uint16_t addr;
+
+    if (mc->f1 == F1_LOAD_MAR && !alto_i) {
+        /* On Alto II MAR<- and <-MD in the same microinstruction
+         * becomes XMAR<-.
+         */
+        return;
+    }
+
+    addr = sim->mar;
+    if (alto_i) {
+        wait_mem_cycle(sim, 5);
+        if (sim->mem_cycle == 5) {
+            sim->mem_status ^= MA_WORD_BIT;
+        } else if (sim->mem_cycle == 6) {
+            if (!(sim->mem_status & MA_WORD_BIT)) {
+                report_error("simulator: step: "
+                             "first write on cycle 6");
+                sim->error = TRUE;
+                return;
+            }
+            addr |= 1;
+            sim->mem_status ^= MA_WORD_BIT;
+        } else {
+            report_error("simulator: step: "
+                         "unexpected write memory cycle");
+            sim->error = TRUE;
+            return;
+        }
+    } else {
+        wait_mem_cycle(sim, 3);
+        if (sim->mem_cycle == 3) {
+            sim->mem_status ^= MA_WORD_BIT;
+        } else if (sim->mem_cycle == 4) {
+            if (sim->mem_status & MA_WORD_BIT) {
+                addr ^= 1;
+            }
+            sim->mem_status ^= MA_WORD_BIT;
+        } else {
+            report_error("simulator: step: "
+                         "unexpected write memory cycle");
+            sim->error = TRUE;
+            return;
+        }
+    }
+    simulator_write(sim, addr, bus, sim->mem_task,
+                    sim->mem_status & MA_EXTENDED);
 }
 
 /* Auxiliary function to obtain the value of the bus.
@@ -616,36 +1120,12 @@ uint16_t read_bus(struct simulator *sim, const struct microcode *mc,
     case BS_NONE:
         break;
     case BS_READ_MD:
-        /* Wait until cycle 5 to perform the read. */
-        while (sim->mem_cycle < 5) {
-            update_cycles(sim);
-        }
-
-        if (mc->sys_type == ALTO_I) {
-            if (sim->mem_cycle == 5) {
-                output &= sim->mem_low;
-            } else if (sim->mem_cycle == 6) {
-                output &= sim->mem_high;
-            } else {
-                report_error("simulator: step: "
-                             "unexpected read memory cycle");
-                sim->error = TRUE;
-                return 0;
-            }
-        } else {
-            /* Alto II. */
-            if (sim->mem_cycle >= 5) {
-                if (sim->mem_status & MA_WORD_BIT) {
-                    output &= sim->mem_high;
-                } else {
-                    output &= sim->mem_low;
-                }
-                sim->mem_status ^= MA_WORD_BIT;
-            }
-        }
+        output &= read_md(sim, mc->sys_type == ALTO_I);
+        if (sim->error) return 0;
         break;
     case BS_READ_MOUSE:
         output &= mouse_poll_bits(&sim->mous);
+        sim->side_effects++;
         break;
     case BS_READ_DISP:
         t = sim->ir & 0x00FFU;
@@ -847,20 +1327,6 @@ uint16_t do_shift(struct simulator *sim, const struct microcode *mc,
     return res;
 }
 
-/* Obtains the pending tasks.
- * Returns a bitset of pending tasks.
- */
-static
-uint16_t get_pending(const struct simulator *sim)
-{
-    uint16_t pending;
-    pending = (1 << TASK_EMULATOR);
-    pending |= sim->dsk.pending;
-    pending |= sim->displ.pending;
-    pending |= sim->ether.pending;
-    return pending;
-}
-
 /* Performs the F1 function.
  * The current predecoded microcode is in `mc`.
  * The value of the bus is in `bus`, and of the alu in `alu`.
@@ -872,9 +1338,6 @@ static
 void do_f1(struct simulator *sim, const struct microcode *mc,
            uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
 {
-    uint16_t addr;
-    uint16_t pending;
-    uint16_t min_cycles;
     uint8_t tmp;
 
     *nntask = sim->ntask;
@@ -891,48 +1354,14 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
         /* Already handled. */
         return;
     case F1_LOAD_MAR:
-        min_cycles = (mc->sys_type == ALTO_I) ? 7 : 5;
-        while (sim->mem_cycle < min_cycles) {
-            update_cycles(sim);
-        }
-        sim->mar = alu;
-        sim->mem_cycle = 1;
-        sim->mem_task = mc->task;
-        sim->mem_status = 0;
-        if (mc->sys_type != ALTO_I && (mc->f2 == F2_STORE_MD)) {
-            sim->mem_status |= MA_EXTENDED;
-        }
-
-        /* Perform the reading now. */
-        addr = sim->mar;
-        sim->mem_low = simulator_read(sim, addr, sim->mem_task,
-                                      sim->mem_status & MA_EXTENDED);
-
-        addr = (mc->sys_type == ALTO_I) ? (1 | addr) : (1 ^ addr);
-        sim->mem_high = simulator_read(sim, addr, sim->mem_task,
-                                       sim->mem_status & MA_EXTENDED);
-
-        /* For TASK_MEMORY_REFRESH, loading MAR with RSEL = 037 performs
-         * a BLOCK.
-         */
-        if (mc->task == TASK_MEMORY_REFRESH) {
-            if ((mc->sys_type == ALTO_I) && (mc->rsel == 037)) {
-                sim->displ.pending &= ~(1 << mc->task);
-            }
-        }
+        load_mar(sim, mc, alu, mc->sys_type == ALTO_I);
         return;
     case F1_TASK:
         /* Should we not prevent two consecutive switches? */
         if (sim->task_switch) return;
 
         /* Switch tasks. */
-        pending = get_pending(sim);
-        for (tmp = TASK_NUM_TASKS; tmp--;) {
-            if (pending & (1 << tmp)) {
-                *nntask = tmp;
-                break;
-            }
-        }
+        *nntask = INTR_NEXT_TASK(&sim->sched);
         return;
     case F1_BLOCK:
         if (mc->task == TASK_EMULATOR) {
@@ -992,6 +1421,7 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
             /* Already handled. */
             break;
         case F1_EMU_STARTF:
+            sim->side_effects++;
             if (bus & 0x8000) {
                 sim->soft_reset = TRUE;
             } else {
@@ -1094,10 +1524,94 @@ void do_f1(struct simulator *sim, const struct microcode *mc,
     }
 }
 
-/* Performs the F2 function.
- * The current predecoded microcode is in `mc`.
- * The value of the bus is in `bus`, the shifter is in `shifter_output`,
- * and the value of the nova style carry is in `nova_carry`.
+/* Executes the BITBLT instruction `insn` natively.
+ * This is called when the emulator task loads the instruction in the IR
+ * register. The scanlines are processed here, at most BITBLT_CHUNK_WORDS
+ * words at a time. The approximate cost of the microcode becomes the
+ * stall of the emulator task (see stall_emulator()), so the other tasks
+ * still run at the same cycles as with the microcode. The instruction
+ * is replaced by a jump to itself, with the number of scanlines done in
+ * AC1 (just like the microcode does when it is interrupted), and it is
+ * not executed again until the stall is over. Once all the scanlines
+ * are done, the microcode runs the instruction (with AC1 at the height
+ * of the rectangle, so that it only does the setup and the cleanup),
+ * which leaves the nova registers as they should be.
+ * Returns the instruction to load in the IR register.
+ */
+static
+uint16_t native_bitblt(struct simulator *sim, uint16_t insn)
+{
+    struct bitblt *bb;
+    uint16_t table[BITBLT_TABLE_SIZE];
+    uint16_t addr, xm_bank, done, count;
+    uint16_t *dmem, *smem, *normal, *alt;
+    unsigned int i, bank;
+    uint32_t line_cycles;
+
+    /* Only from the instruction fetch of the standard microcode (the
+     * microcode also loads IR to dispatch on other values).
+     */
+    if (sim->sys_type == ALTO_I || !sim->std_rom) return insn;
+    if (((sim->mpc >> MPC_BANK_SHIFT) & MPC_BANK_MASK) != 0) return insn;
+    if ((uint16_t) (sim->mar + 1) != sim->r[6]) return insn;
+
+    /* The previous chunk is not paid for yet. */
+    if (sim->bitblt_stall != 0) return NOVA_JMP_SELF;
+
+    xm_bank = sim->xm_banks[TASK_EMULATOR];
+    normal = &sim->mem[((xm_bank >> 2) & 0x3) * MEMORY_SIZE];
+    alt = &sim->mem[(xm_bank & 0x3) * MEMORY_SIZE];
+
+    addr = sim->r[1]; /* AC2 */
+    if (((uint32_t) addr) + BITBLT_TABLE_SIZE > MEMORY_TOP) return insn;
+    for (i = 0; i < BITBLT_TABLE_SIZE; i++)
+        table[i] = normal[addr + i];
+
+    bb = sim->bb;
+    if (!bitblt_decode(bb, table)) return insn;
+
+    done = sim->r[2]; /* AC1 */
+    if (done >= bb->dh) return insn;
+
+    count = bb->dh - done;
+    if (count > BITBLT_CHUNK_WORDS / bb->num_words) {
+        count = BITBLT_CHUNK_WORDS / bb->num_words;
+        if (count == 0) count = 1;
+    }
+
+    line_cycles = bb->num_words
+        * BITBLT_WORD_CYCLES[(bb->function & BITBLT_SOURCE_TYPE) >> 2]
+        + BITBLT_LINE_CYCLES;
+
+    dmem = (bb->function & BITBLT_DEST_ALT) ? alt : normal;
+    smem = (bb->function & BITBLT_SOURCE_ALT) ? alt : normal;
+    if (!bitblt_check(bb, done, done + count, MEMORY_TOP, dmem == smem))
+        return insn;
+
+    sim->side_effects++;
+    if (bitblt_run(bb, dmem, smem, done, done + count)) {
+        sim->mem_changes++;
+
+        /* The destination is written directly (not with
+         * simulator_write()), so the translated blocks are
+         * invalidated here.
+         */
+        bank = (dmem == alt) ? (xm_bank & 0x3) : ((xm_bank >> 2) & 0x3);
+        for (i = done; i < done + count; i++) {
+            blkcache_write_range(&sim->bc, bank, bitblt_dest_addr(bb, i),
+                                 bb->num_words);
+        }
+    }
+
+    sim->bitblt_stall = ((uint32_t) count) * line_cycles;
+    sim->r[2] = done + count;
+    return NOVA_JMP_SELF;
+}
+
+/* Performs the F2 function.
+ * The current predecoded microcode is in `mc`.
+ * The value of the bus is in `bus`, the shifter is in `shifter_output`,
+ * and the value of the nova style carry is in `nova_carry`.
  * Retuns the bits that should be modified for the NEXT part of the
  * following instruction.
  */
@@ -1106,7 +1620,6 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
                uint16_t bus, uint16_t shifter_output, int nova_carry)
 {
     uint16_t next_extra;
-    uint16_t addr;
 
     /* Computes the F2 function. */
     switch (mc->f2) {
@@ -1127,55 +1640,7 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
     case F2_ALUCY:
         return (sim->aluC0) ? 1 : 0;
     case F2_STORE_MD:
-        if (mc->f1 == F1_LOAD_MAR && mc->sys_type != ALTO_I) {
-            /* On Alto II MAR<- and <-MD in the same microinstruction
-             * becomes XMAR<-.
-             */
-            return 0;
-        }
-
-        addr = sim->mar;
-        if (mc->sys_type == ALTO_I) {
-            while (sim->mem_cycle < 5) {
-                update_cycles(sim);
-            }
-            if (sim->mem_cycle == 5) {
-                sim->mem_status ^= MA_WORD_BIT;
-            } else if (sim->mem_cycle == 6) {
-                if (!(sim->mem_status & MA_WORD_BIT)) {
-                    report_error("simulator: step: "
-                                 "first write on cycle 6");
-                    sim->error = TRUE;
-                    return 0;
-                }
-                addr |= 1;
-                sim->mem_status ^= MA_WORD_BIT;
-            } else {
-                report_error("simulator: step: "
-                             "unexpected write memory cycle");
-                sim->error = TRUE;
-                return 0;
-            }
-        } else {
-            while (sim->mem_cycle < 3) {
-                update_cycles(sim);
-            }
-            if (sim->mem_cycle == 3) {
-                sim->mem_status ^= MA_WORD_BIT;
-            } else if (sim->mem_cycle == 4) {
-                if (sim->mem_status & MA_WORD_BIT) {
-                    addr ^= 1;
-                }
-                sim->mem_status ^= MA_WORD_BIT;
-            } else {
-                report_error("simulator: step: "
-                             "unexpected write memory cycle");
-                sim->error = TRUE;
-                return 0;
-            }
-        }
-        simulator_write(sim, addr, bus, sim->mem_task,
-                        sim->mem_status & MA_EXTENDED);
+        store_md(sim, mc, bus, mc->sys_type == ALTO_I);
         return 0;
     }
 
@@ -1220,7 +1685,11 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
             }
             return 0;
         case F2_EMU_LOAD_IR:
+            if (unlikely(bus == NOVA_BITBLT) && sim->native_bitblt
+                && !sim->single_step)
+                bus = native_bitblt(sim, bus);
             sim->ir = bus;
+            sim->ir_loads++;
             sim->skip = FALSE;
             next_extra = (bus >> 8) & 0x7;
             if (bus & 0x8000) next_extra |= 0x8;
@@ -1316,13 +1785,6 @@ uint16_t do_f2(struct simulator *sim, const struct microcode *mc,
             sim->error = TRUE;
             return 0;
         }
-        if (unlikely(!update_intr_cycle(sim, FALSE))) {
-            report_error("simulator: step: "
-                         "error in computing interrupt cycle "
-                         "after ethernet function");
-            return 0;
-        }
-
         break;
 
     case TASK_DISPLAY_WORD:
@@ -1435,6 +1897,7 @@ void wb_registers(struct simulator *sim,
         if (mc->ram_task && mc->bs == BS_RAM_LOAD_S_LOCATION) {
             rb = sim->sreg_banks[mc->task];
             sim->s[rb * NUM_R_REGISTERS + mc->rsel] = sim->m;
+            sim->side_effects++;
         }
     }
 
@@ -1459,13 +1922,15 @@ void wb_registers(struct simulator *sim,
 }
 
 /* Updates the micro program counter and the next task.
+ * The system type is given by `sys_type`.
  * The bits that are to be modified in the NEXT field of the following
  * instruction are given by `next_extra`. The task following the next
  * instruction is given by `nntask`. If the SWMODE instruction was
  * executed before this one, the flag `swmode` is set to TRUE.
  */
-static
+static __inline__
 void update_program_counters(struct simulator *sim,
+                             enum system_type sys_type,
                              uint16_t next_extra, uint8_t nntask,
                              int swmode)
 {
@@ -1486,61 +1951,7 @@ void update_program_counters(struct simulator *sim,
     next_addr = MICROCODE_NEXT(mcode) | next_extra;
     bank = (mpc >> MPC_BANK_SHIFT) & MPC_BANK_MASK;
     if (swmode) {
-        switch (sim->sys_type) {
-        case ALTO_I:
-        case ALTO_II_1KROM:
-            bank ^= 1; /* ROM0 <-> RAM0 */
-            break;
-
-        case ALTO_II_2KROM:
-            switch (bank) {
-            case 0: /* ROM0 */
-                /* ROM1 or RAM0 */
-                bank = (next_addr & 0x100) ? 1 : 2; break;
-            case 1: /* ROM1 */
-                /* RAM0 or ROM0 */
-                bank = (next_addr & 0x100) ? 2 : 0; break;
-            case 2: /* RAM0 */
-                /* ROM1 or ROM0 */
-                bank = (next_addr & 0x100) ? 1 : 0; break;
-            }
-            break;
-
-        case ALTO_II_3KRAM:
-            if (next_addr & 0x100) {
-                switch (bank) {
-                case 0: /* ROM0 */
-                    /* RAM0 or RAM1 */
-                    bank = (next_addr & 0x80) ? 1 : 2;
-                    break;
-                case 1: /* RAM0 */
-                    bank = 2; /* RAM1 */
-                    break;
-                case 2: /* RAM1 */
-                case 3: /* RAM2 */
-                    bank = 1; /* RAM0 */
-                    break;
-                }
-            } else {
-                switch (bank) {
-                case 0: /* ROM0 */
-                    /* RAM2 or RAM0 */
-                    bank = (next_addr & 0x80) ? 3 : 1;
-                    break;
-                case 1: /* RAM0 */
-                case 2: /* RAM1 */
-                    /* RAM2 or ROM0 */
-                    bank = (next_addr & 0x80) ? 3 : 0;
-                    break;
-                case 3: /* RAM2 */
-                    /* RAM1 or ROM0 */
-                    bank = (next_addr & 0x80) ? 2 : 0;
-                    break;
-                }
-            }
-
-            break;
-        }
+        bank = SWMODE_BANKS[sys_type][bank][(next_addr >> 7) & 3];
     }
     sim->task_mpc[task] = (bank << MPC_BANK_SHIFT) | next_addr;
 
@@ -1579,6 +1990,7 @@ void do_soft_reset(struct simulator *sim)
     uint8_t task;
 
     memset(sim->xm_banks, 0, TASK_NUM_TASKS * sizeof(uint16_t));
+    update_mem_bases(sim);
 
     if (sim->sys_type == ALTO_II_2KROM) {
         bank = 2;
@@ -1605,217 +2017,1416 @@ void do_soft_reset(struct simulator *sim)
         | MICROCODE_NEXT(sim->mir);
 
     /* This is a hack copied from ContrAlto source code. */
-    sim->dsk.pending |= (1 << TASK_DISK_SECTOR);
-    sim->dsk.pending &= ~(1 << TASK_DISK_WORD);
+    INTR_WAKEUP(&sim->sched, TASK_DISK_SECTOR);
+    INTR_BLOCK(&sim->sched, TASK_DISK_WORD);
     sim->rmr = 0xFFFF;
 }
 
 /* Checks for interrupts.
- * The parameter `prev_cycle` records the number of cycles before
- * the execution of the last microinstruction.
+ * Dispatches all the events scheduled before the current cycle.
  */
 static
-void check_for_interrupts(struct simulator *sim, int32_t prev_cycle)
+void check_for_interrupts(struct simulator *sim)
 {
-    int32_t diff, intr_diff;
-
     while (TRUE) {
-        if (sim->intr_cycle < 0) return;
-
-        diff = INTR_CYCLE(sim->cycle - prev_cycle);
-        intr_diff = INTR_CYCLE(sim->intr_cycle - prev_cycle);
-        if (diff <= intr_diff) break;
-
-        /* Updates prev_cycle to match the current interrupt time. */
-        prev_cycle = INTR_CYCLE(prev_cycle + intr_diff);
+        if (sim->sched.next_cycle < 0) return;
+        if (sim->sched.next_cycle >= sim->cycle) break;
 
         /* Dispatch the interrupts. */
-        if (sim->intr_cycle == sim->dsk.intr_cycle) {
-            if (unlikely(!disk_interrupt(&sim->dsk))) {
-                report_error("simulator: step: "
-                             "could not process disk interrupt");
-                sim->error = TRUE;
-                return;
-            }
+        if (unlikely(!intr_dispatch(&sim->sched))) {
+            report_error("simulator: step: "
+                         "could not process interrupts");
+            sim->error = TRUE;
+            return;
         }
-        if (sim->intr_cycle == sim->displ.intr_cycle) {
-            if (unlikely(!display_interrupt(&sim->displ))) {
-                report_error("simulator: step: "
-                             "could not process display interrupt");
-                sim->error = TRUE;
-                return;
-            }
 
-            /* Transfer the TASK_ETHERNET pending bit
-             * to the ethernet object.
-             */
-            if (sim->displ.pending & (1 << TASK_ETHERNET)) {
-                sim->displ.pending &= ~(1 << TASK_ETHERNET);
-                if (sim->ether.countdown_wakeup) {
-                    sim->ether.pending |= (1 << TASK_ETHERNET);
-                }
-            }
-        }
-        if (sim->intr_cycle == sim->ether.intr_cycle) {
-            if (unlikely(!ethernet_interrupt(&sim->ether))) {
-                report_error("simulator: step: "
-                             "could not process ethernet interrupt");
-                sim->error = TRUE;
-                return;
+        /* The wakeup of the memory refresh task also wakes up the
+         * ethernet task when the countdown wakeup is set.
+         */
+        if (sim->displ.refresh_wakeup) {
+            sim->displ.refresh_wakeup = FALSE;
+            if (sim->ether.countdown_wakeup) {
+                INTR_WAKEUP(&sim->sched, TASK_ETHERNET);
             }
         }
-
-        if (unlikely(!update_intr_cycle(sim, TRUE))) {
-            report_error("simulator: step: "
-                         "error in computing interrupt cycle");
-            return;
-        }
     }
 }
 
-void simulator_step(struct simulator *sim)
-{
-    struct microcode mc;
-    int32_t prev_cycle;
-    uint16_t modified_rsel;
-    uint16_t bus;
-    uint16_t alu;
-    uint16_t shifter_output;
-    uint16_t next_extra;
-    uint8_t nntask;
-    int aluC0;
-    int nova_carry;
-    int load_r;
-    int swmode;
-    int soft_reset;
+/* Handlers for the threaded engine.
+ * These are specialized versions of read_bus(), compute_alu(),
+ * do_shift(), do_f1() and do_f2() for the most common microinstructions.
+ * They are bound to the entries of the predecoded microcode cache by
+ * bind_handlers(), and the generic versions are used for everything
+ * else.
+ */
 
-    if (sim->error) {
-        report_error("simulator: step: "
-                     "simulator is in error state");
-        return;
-    }
+/* Bus handler for microinstructions using a constant. */
+static
+uint16_t bus_constant(struct simulator *sim, const struct microcode *mc,
+                      uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return sim->consts[mc->const_addr];
+}
 
-    /* Copy this to detect interrupts later. */
-    prev_cycle = sim->cycle;
+/* Bus handler for BS_READ_R. */
+static
+uint16_t bus_read_r(struct simulator *sim, const struct microcode *mc,
+                    uint16_t modified_rsel)
+{
+    UNUSED(mc);
+    return sim->r[modified_rsel];
+}
 
-    /* Updates the cycles. */
-    update_cycles(sim);
+/* Bus handler for BS_LOAD_R. */
+static
+uint16_t bus_load_r(struct simulator *sim, const struct microcode *mc,
+                    uint16_t modified_rsel)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(modified_rsel);
+    return 0;
+}
 
-    /* The Ethernet cycle needs to run ethernet_before_step() before*
-     * every step.
-     */
-    if (sim->ctask == TASK_ETHERNET) {
-        ethernet_before_step(&sim->ether);
-    }
+/* Bus handler for BS_NONE. */
+static
+uint16_t bus_none(struct simulator *sim, const struct microcode *mc,
+                  uint16_t modified_rsel)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(modified_rsel);
+    return 0xFFFFU;
+}
 
-    /* Copy the soft_reset in a local variable. */
-    soft_reset = sim->soft_reset;
-    sim->soft_reset = FALSE;
+/* Bus handler for BS_READ_MD on the Alto I. */
+static
+uint16_t bus_read_md_alto_i(struct simulator *sim,
+                            const struct microcode *mc,
+                            uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return sim->consts[mc->const_addr] & read_md(sim, TRUE);
+}
 
-    microcode_predecode(&mc,
-                        sim->sys_type,
-                        sim->mpc,
-                        sim->mir,
-                        sim->ctask);
+/* Bus handler for BS_READ_MD on the Alto II. */
+static
+uint16_t bus_read_md_alto_ii(struct simulator *sim,
+                             const struct microcode *mc,
+                             uint16_t modified_rsel)
+{
+    UNUSED(modified_rsel);
+    return sim->consts[mc->const_addr] & read_md(sim, FALSE);
+}
 
-    load_r = (!mc.use_constant && mc.bs == BS_LOAD_R);
+/* Defines an ALU handler named `name`, which computes `expr` with
+ * the bus in `a` and the T register in `b`.
+ */
+#define ALU_HANDLER(name, expr)                                        \
+static                                                                 \
+uint16_t name(struct simulator *sim, const struct microcode *mc,       \
+              uint16_t bus, int *carry)                                \
+{                                                                      \
+    uint32_t res;                                                      \
+    uint32_t a, b;                                                     \
+                                                                       \
+    UNUSED(mc);                                                        \
+    a = (uint32_t) bus;                                                \
+    b = (uint32_t) sim->t;                                             \
+    UNUSED(a);                                                         \
+    UNUSED(b);                                                         \
+    res = (expr);                                                      \
+    *carry = ((res & 0xFFFF0000) != 0) ? 1 : 0;                        \
+    return (uint16_t) res;                                             \
+}
 
-    /* Obtain the rsel (which might be modified by some F2
-     * functions when in the EMULATOR task.
-     */
-    modified_rsel = get_modified_rsel(sim, &mc);
+ALU_HANDLER(alu_bus, a)
+ALU_HANDLER(alu_t, b)
+ALU_HANDLER(alu_bus_or_t, a | b)
+ALU_HANDLER(alu_bus_and_t, a & b)
+ALU_HANDLER(alu_bus_xor_t, a ^ b)
+ALU_HANDLER(alu_bus_plus_1, a + 1)
+ALU_HANDLER(alu_bus_minus_1, a + 0xFFFFU)
+ALU_HANDLER(alu_bus_plus_t, a + b)
+ALU_HANDLER(alu_bus_minus_t, a + ((~b) & 0xFFFFU) + 1)
+ALU_HANDLER(alu_bus_minus_t_minus_1, a + ((~b) & 0xFFFFU))
+ALU_HANDLER(alu_bus_plus_t_plus_1, a + b + 1)
+ALU_HANDLER(alu_bus_plus_skip, a + ((uint32_t) (sim->skip ? 1 : 0)))
+ALU_HANDLER(alu_bus_and_not_t, a & (~b) & 0xFFFFU)
+
+#undef ALU_HANDLER
+
+/* Shifter handler when there is no shift (and no nova style shift). */
+static
+uint16_t shift_none(struct simulator *sim, const struct microcode *mc,
+                    int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l;
+}
 
-    /* Compute the bus. */
-    bus = read_bus(sim, &mc, modified_rsel);
-    if (sim->error) return;
+/* Shifter handler for F1_LLSH1 (without nova style shift). */
+static
+uint16_t shift_llsh1(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l << 1;
+}
 
-    /* Compute the ALU. */
-    alu = compute_alu(sim, &mc, bus, &aluC0);
-    if (sim->error) return;
+/* Shifter handler for F1_LRSH1 (without nova style shift). */
+static
+uint16_t shift_lrsh1(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return sim->l >> 1;
+}
 
-    /* Perform pending writes to the microcode RAM. */
-    do_wrtram(sim, alu);
+/* Shifter handler for F1_LLCY8 (without nova style shift). */
+static
+uint16_t shift_llcy8(struct simulator *sim, const struct microcode *mc,
+                     int *load_r, int *nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(load_r);
+    *nova_carry = 0;
+    return (sim->l << 8) | (sim->l >> 8);
+}
 
-    /* Compute the shifter output. */
-    shifter_output = do_shift(sim, &mc, &load_r, &nova_carry);
+/* F1 handler for the functions that have nothing to do. */
+static
+void f1_none(struct simulator *sim, const struct microcode *mc,
+             uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(alu);
+    *nntask = sim->ntask;
+    *swmode = FALSE;
+}
 
-    /* Compute the F1 function. */
-    do_f1(sim, &mc, bus, alu, &nntask, &swmode);
-    if (sim->error) return;
+/* F1 handler for F1_TASK. */
+static
+void f1_task(struct simulator *sim, const struct microcode *mc,
+             uint16_t bus, uint16_t alu, uint8_t *nntask, int *swmode)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(alu);
+    *nntask = sim->ntask;
+    *swmode = FALSE;
 
-    /* Compute the F2 function. */
-    next_extra = do_f2(sim, &mc, bus, shifter_output, nova_carry);
-    if (sim->error) return;
+    if (sim->task_switch) return;
 
-    /* Perform the BLOCK operation. */
-    if (mc.f1 == F1_BLOCK) do_block(sim, mc.task);
+    *nntask = INTR_NEXT_TASK(&sim->sched);
+}
 
-    /* Write back the registers. */
-    wb_registers(sim, &mc, modified_rsel, load_r,
-                 bus, alu, shifter_output, aluC0);
+/* F1 handler for F1_LOAD_MAR on the Alto I. */
+static
+void f1_load_mar_alto_i(struct simulator *sim, const struct microcode *mc,
+                        uint16_t bus, uint16_t alu,
+                        uint8_t *nntask, int *swmode)
+{
+    UNUSED(bus);
+    *nntask = sim->ntask;
+    *swmode = FALSE;
+    load_mar(sim, mc, alu, TRUE);
+}
 
-    /* Update the micro program counter and the next task. */
-    update_program_counters(sim, next_extra, nntask, swmode);
+/* F1 handler for F1_LOAD_MAR on the Alto II. */
+static
+void f1_load_mar_alto_ii(struct simulator *sim, const struct microcode *mc,
+                         uint16_t bus, uint16_t alu,
+                         uint8_t *nntask, int *swmode)
+{
+    UNUSED(bus);
+    *nntask = sim->ntask;
+    *swmode = FALSE;
+    load_mar(sim, mc, alu, FALSE);
+}
 
-    /* Perform the soft reset. */
-    if (soft_reset) do_soft_reset(sim);
+/* F2 handler for the functions that have nothing to do. */
+static
+uint16_t f2_none(struct simulator *sim, const struct microcode *mc,
+                 uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return 0;
+}
 
-    check_for_interrupts(sim, prev_cycle);
+/* F2 handler for F2_BUSEQ0. */
+static
+uint16_t f2_buseq0(struct simulator *sim, const struct microcode *mc,
+                   uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus == 0) ? 1 : 0;
 }
 
-int simulator_update(struct simulator *sim,
-                     const struct keyboard *keyb,
-                     const struct mouse *mous,
-                     uint8_t *display_data)
+/* F2 handler for F2_SHLT0. */
+static
+uint16_t f2_shlt0(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
 {
-    if (display_data) {
-        memcpy(display_data, sim->displ.display_data,
-               DISPLAY_DATA_SIZE * sizeof(uint8_t));
-    }
-    if (keyb) {
-        keyboard_update_from(&sim->keyb, keyb);
-    }
-    if (mous) {
-        mouse_update_from(&sim->mous, mous);
-    }
-    return TRUE;
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(nova_carry);
+    return (shifter_output & 0x8000) ? 1 : 0;
 }
 
-void simulator_predecode(const struct simulator *sim,
-                         struct microcode *mc)
+/* F2 handler for F2_SHEQ0. */
+static
+uint16_t f2_sheq0(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
 {
-    microcode_predecode(mc,
-                        sim->sys_type,
-                        sim->mpc,
-                        sim->mir,
-                        sim->ctask);
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(nova_carry);
+    return (shifter_output == 0) ? 1 : 0;
 }
 
-void simulator_nova_predecode(const struct simulator *sim,
-                              struct nova_insn *ni)
+/* F2 handler for F2_BUS. */
+static
+uint16_t f2_bus(struct simulator *sim, const struct microcode *mc,
+                uint16_t bus, uint16_t shifter_output, int nova_carry)
 {
-    uint16_t address, insn;
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus & MPC_ADDR_MASK);
+}
 
-    address = sim->r[6];
-    insn = simulator_read(sim, address, TASK_EMULATOR, FALSE);
-    nova_insn_predecode(ni, address, insn);
+/* F2 handler for F2_ALUCY. */
+static
+uint16_t f2_alucy(struct simulator *sim, const struct microcode *mc,
+                  uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(mc);
+    UNUSED(bus);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (sim->aluC0) ? 1 : 0;
 }
 
-void simulator_print_registers(const struct simulator *sim,
-                               struct decoder *dec)
+/* F2 handler for F2_STORE_MD on the Alto I. */
+static
+uint16_t f2_store_md_alto_i(struct simulator *sim,
+                            const struct microcode *mc,
+                            uint16_t bus, uint16_t shifter_output,
+                            int nova_carry)
 {
-    struct string_buffer *output;
-    uint16_t pending;
-    unsigned int i;
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    store_md(sim, mc, bus, TRUE);
+    return 0;
+}
 
-    output = dec->output;
-    decode_tagged_value(dec->vdec, "T", DECODE_VALUE, sim->t);
-    decode_tagged_value(dec->vdec, "L", DECODE_VALUE, sim->l);
-    decode_tagged_value(dec->vdec, "MAR", DECODE_MEMORY, sim->mar);
-    decode_tagged_value(dec->vdec, "IR", DECODE_VALUE, sim->ir);
-    string_buffer_print(output, "\n");
+/* F2 handler for F2_STORE_MD on the Alto II. */
+static
+uint16_t f2_store_md_alto_ii(struct simulator *sim,
+                             const struct microcode *mc,
+                             uint16_t bus, uint16_t shifter_output,
+                             int nova_carry)
+{
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    store_md(sim, mc, bus, FALSE);
+    return 0;
+}
 
-    for (i = 0; i < NUM_R_REGISTERS; i++) {
+/* F2 handler for F2_EMU_BUSODD. */
+static
+uint16_t f2_busodd(struct simulator *sim, const struct microcode *mc,
+                   uint16_t bus, uint16_t shifter_output, int nova_carry)
+{
+    UNUSED(sim);
+    UNUSED(mc);
+    UNUSED(shifter_output);
+    UNUSED(nova_carry);
+    return (bus & 1);
+}
+
+/* Binds the handlers of the stages of a predecoded microinstruction.
+ * The entry of the cache is given by `e`. The generic handlers are
+ * always used by the interpreter engine.
+ */
+static
+void bind_handlers(const struct simulator *sim, struct mc_entry *e)
+{
+    const struct microcode *mc;
+    int emu, alto_i;
+
+    e->read_bus = &read_bus;
+    e->compute_alu = &compute_alu;
+    e->do_shift = &do_shift;
+    e->do_f1 = &do_f1;
+    e->do_f2 = &do_f2;
+
+    if (sim->engine != SIM_ENGINE_THREADED) return;
+
+    mc = &e->mc;
+    emu = (mc->task == TASK_EMULATOR);
+    alto_i = (mc->sys_type == ALTO_I);
+
+    /* The bus handlers are only specialized when no F1 function
+     * modifies the bus.
+     */
+    if (!(emu && mc->f1 == F1_EMU_RSNF)
+        && !(mc->task == TASK_ETHERNET
+             && (mc->f1 == F1_ETH_EILFCT || mc->f1 == F1_ETH_EPFCT))) {
+        if (mc->use_constant) {
+            e->read_bus = &bus_constant;
+        } else {
+            switch (mc->bs) {
+            case BS_READ_R: e->read_bus = &bus_read_r; break;
+            case BS_LOAD_R: e->read_bus = &bus_load_r; break;
+            case BS_NONE: e->read_bus = &bus_none; break;
+            case BS_READ_MD:
+                e->read_bus = (alto_i) ? &bus_read_md_alto_i
+                                       : &bus_read_md_alto_ii;
+                break;
+            }
+        }
+    }
+
+    switch (mc->aluf) {
+    case ALU_BUS: e->compute_alu = &alu_bus; break;
+    case ALU_T: e->compute_alu = &alu_t; break;
+    case ALU_BUS_OR_T: e->compute_alu = &alu_bus_or_t; break;
+    case ALU_BUS_AND_T:
+    case ALU_BUS_AND_T_WB: e->compute_alu = &alu_bus_and_t; break;
+    case ALU_BUS_XOR_T: e->compute_alu = &alu_bus_xor_t; break;
+    case ALU_BUS_PLUS_1: e->compute_alu = &alu_bus_plus_1; break;
+    case ALU_BUS_MINUS_1: e->compute_alu = &alu_bus_minus_1; break;
+    case ALU_BUS_PLUS_T: e->compute_alu = &alu_bus_plus_t; break;
+    case ALU_BUS_MINUS_T: e->compute_alu = &alu_bus_minus_t; break;
+    case ALU_BUS_MINUS_T_MINUS_1:
+        e->compute_alu = &alu_bus_minus_t_minus_1; break;
+    case ALU_BUS_PLUS_T_PLUS_1: e->compute_alu = &alu_bus_plus_t_plus_1; break;
+    case ALU_BUS_PLUS_SKIP: e->compute_alu = &alu_bus_plus_skip; break;
+    case ALU_BUS_AND_NOT_T: e->compute_alu = &alu_bus_and_not_t; break;
+    }
+
+    /* The nova style shifts are left to the generic handler. */
+    if (!(emu && (mc->f2 == F2_EMU_LOAD_DNS || mc->f2 == F2_EMU_MAGIC))) {
+        switch (mc->f1) {
+        case F1_LLSH1: e->do_shift = &shift_llsh1; break;
+        case F1_LRSH1: e->do_shift = &shift_lrsh1; break;
+        case F1_LLCY8: e->do_shift = &shift_llcy8; break;
+        default: e->do_shift = &shift_none; break;
+        }
+    }
+
+    switch (mc->f1) {
+    case F1_NONE:
+    case F1_CONSTANT:
+    case F1_LLSH1:
+    case F1_LRSH1:
+    case F1_LLCY8:
+        e->do_f1 = &f1_none;
+        break;
+    case F1_LOAD_MAR:
+        e->do_f1 = (alto_i) ? &f1_load_mar_alto_i : &f1_load_mar_alto_ii;
+        break;
+    case F1_TASK:
+        e->do_f1 = &f1_task;
+        break;
+    }
+
+    switch (mc->f2) {
+    case F2_NONE:
+    case F2_CONSTANT: e->do_f2 = &f2_none; break;
+    case F2_BUSEQ0: e->do_f2 = &f2_buseq0; break;
+    case F2_SHLT0: e->do_f2 = &f2_shlt0; break;
+    case F2_SHEQ0: e->do_f2 = &f2_sheq0; break;
+    case F2_BUS: e->do_f2 = &f2_bus; break;
+    case F2_ALUCY: e->do_f2 = &f2_alucy; break;
+    case F2_STORE_MD:
+        e->do_f2 = (alto_i) ? &f2_store_md_alto_i : &f2_store_md_alto_ii;
+        break;
+    default:
+        if (!emu) break;
+        switch (mc->f2) {
+        case F2_EMU_MAGIC:
+        case F2_EMU_ACDEST: e->do_f2 = &f2_none; break;
+        case F2_EMU_BUSODD: e->do_f2 = &f2_busodd; break;
+        }
+        break;
+    }
+}
+
+/* Advances the nova timing `nt` by one microinstruction that does not
+ * access the memory (as update_cycles() does).
+ */
+static __inline__
+void nova_timing_step(struct nova_timing *nt)
+{
+    nt->cycles++;
+    if (nt->mem_cycle != 0xFFFF) {
+        if (nt->mem_cycle >= 10) {
+            nt->mem_cycle = 0xFFFF;
+        } else {
+            nt->mem_cycle += 1;
+        }
+    }
+}
+
+/* Stalls the nova timing `nt` until the memory cycle reaches `mem_cycle`
+ * (as wait_mem_cycle() does).
+ */
+static __inline__
+void nova_timing_wait(struct nova_timing *nt, uint16_t mem_cycle)
+{
+    uint16_t num_cycles;
+
+    if (nt->mem_cycle >= mem_cycle) return;
+    num_cycles = mem_cycle - nt->mem_cycle;
+    nt->cycles += num_cycles;
+    if (nt->mem_cycle + num_cycles > 10) {
+        nt->mem_cycle = 0xFFFF;
+    } else {
+        nt->mem_cycle += num_cycles;
+    }
+}
+
+/* Advances the nova timing `nt` by `num_steps` microinstructions that
+ * do not access the memory.
+ */
+#define NOVA_STEPS(nt, num_steps)                                      \
+    do {                                                               \
+        unsigned int _i;                                               \
+        for (_i = 0; _i < (num_steps); _i++)                           \
+            nova_timing_step(nt);                                      \
+    } while (0)
+
+/* Marks the next microinstruction as one with TASK in the nova
+ * timing `nt`.
+ */
+#define NOVA_TASK(nt) ((nt)->task_cycles = (nt)->cycles)
+
+/* Advances the nova timing `nt` by a microinstruction that loads
+ * the MAR (see load_mar()).
+ */
+#define NOVA_LOAD_MAR(nt)                                              \
+    do {                                                               \
+        nova_timing_step(nt);                                          \
+        nova_timing_wait(nt, 5);                                       \
+        (nt)->mem_cycle = 1;                                           \
+    } while (0)
+
+/* Advances the nova timing `nt` by a microinstruction that reads the
+ * memory data (see read_md()).
+ */
+#define NOVA_READ_MD(nt)                                               \
+    do {                                                               \
+        nova_timing_step(nt);                                          \
+        nova_timing_wait(nt, 5);                                       \
+    } while (0)
+
+/* Advances the nova timing `nt` by a microinstruction that stores the
+ * memory data (see store_md()).
+ */
+#define NOVA_STORE_MD(nt)                                              \
+    do {                                                               \
+        nova_timing_step(nt);                                          \
+        nova_timing_wait(nt, 3);                                       \
+    } while (0)
+
+/* Obtains the accumulator `ac` of the nova (they are stored in the
+ * R registers in reverse order).
+ */
+#define NOVA_AC(sim, ac) ((sim)->r[3 - (ac)])
+
+/* Executes the arithmetic and logic instruction `insn` (as the microcode
+ * does). The address of the instruction is `pc`.
+ */
+static
+void native_nova_alu(struct simulator *sim, uint16_t insn, uint16_t pc)
+{
+    uint16_t src, dst, res;
+    uint32_t sum;
+    int carry, new_carry, skip;
+
+    src = NOVA_AC(sim, (insn >> 13) & 3);
+    dst = NOVA_AC(sim, (insn >> 11) & 3);
+
+    switch ((insn >> 4) & 3) {
+    case 0: carry = sim->carry; break;
+    case 1: carry = FALSE; break;
+    case 2: carry = TRUE; break;
+    default: carry = !sim->carry; break;
+    }
+
+    sum = 0;
+    switch ((insn >> 8) & 7) {
+    case 0: /* COM */
+        sum = (uint16_t) ~src;
+        break;
+    case 1: /* NEG */
+        sum = ((uint32_t) (uint16_t) ~src) + 1;
+        break;
+    case 2: /* MOV */
+        sum = src;
+        break;
+    case 3: /* INC */
+        sum = ((uint32_t) src) + 1;
+        break;
+    case 4: /* ADC */
+        sum = ((uint32_t) (uint16_t) ~src) + dst;
+        break;
+    case 5: /* SUB */
+        sum = ((uint32_t) (uint16_t) ~src) + dst + 1;
+        break;
+    case 6: /* ADD */
+        sum = ((uint32_t) src) + dst;
+        break;
+    case 7: /* AND */
+        sum = src & dst;
+        break;
+    }
+    res = (uint16_t) sum;
+    if (sum & 0x10000) carry = !carry;
+
+    switch ((insn >> 6) & 3) {
+    case 1: /* L */
+        new_carry = (res >> 15) & 1;
+        res = (uint16_t) ((res << 1) | (carry ? 1 : 0));
+        carry = new_carry;
+        break;
+    case 2: /* R */
+        new_carry = res & 1;
+        res = (uint16_t) ((res >> 1) | (carry ? 0x8000 : 0));
+        carry = new_carry;
+        break;
+    case 3: /* S */
+        res = (uint16_t) ((res << 8) | (res >> 8));
+        break;
+    }
+
+    switch (insn & 7) {
+    case 0: skip = FALSE; break;
+    case 1: skip = TRUE; break;
+    case 2: skip = !carry; break;
+    case 3: skip = carry; break;
+    case 4: skip = (res == 0); break;
+    case 5: skip = (res != 0); break;
+    case 6: skip = (res == 0 || !carry); break;
+    default: skip = (res != 0 && carry); break;
+    }
+
+    if ((insn & 0x0008) == 0) {
+        NOVA_AC(sim, (insn >> 11) & 3) = res;
+        sim->carry = carry;
+    }
+    sim->r[6] = pc + 1;
+    sim->skip = skip;
+}
+
+/* Executes natively the translated nova instruction `ni`, which is at
+ * address `pc` of the memory bank `mem` of the emulator. The emulator
+ * must be at the START of its main loop, and it must be able to run the
+ * instruction without being preempted (see native_nova()).
+ * The instruction is left to the microcode if a timer expires before
+ * its last microinstruction with TASK, or if it accesses the memory at
+ * or above MEMORY_TOP.
+ * The registers, the memory and the cycle counters are left exactly as
+ * the microcode would leave them at the START of the next instruction
+ * (except for the registers T, L, M and MAR, and the memory latches,
+ * which are only used within an instruction).
+ * Returns TRUE if the instruction was executed.
+ */
+static
+int native_nova_insn(struct simulator *sim, const struct blk_insn *ni,
+                     uint16_t pc, const uint16_t *mem)
+{
+    struct nova_timing nt;
+    uint16_t ptr, addr, value;
+    int skip;
+
+    nt.cycles = 0;
+    nt.task_cycles = 0;
+    nt.mem_cycle = sim->mem_cycle;
+
+    /* From the START to the dispatch of the instruction. */
+    NOVA_LOAD_MAR(&nt);
+    NOVA_STEPS(&nt, 3);
+    NOVA_READ_MD(&nt);
+    NOVA_STEPS(&nt, 1);
+
+    /* When the display is active, the timers usually expire even before
+     * the dispatch, so this is checked early.
+     */
+    if (sim->sched.next_cycle >= 0
+        && sim->sched.next_cycle < sim->cycle + nt.cycles)
+        return FALSE;
+
+    ptr = 0;
+    addr = 0;
+    value = 0;
+    skip = FALSE;
+    if (ni->op == BLK_OP_ALU) {
+        NOVA_TASK(&nt);
+        NOVA_STEPS(&nt, 2);
+    } else {
+        /* The effective address. */
+        switch (ni->mode) {
+        case 0:
+            addr = ni->disp;
+            break;
+        case 1:
+            addr = pc + ni->disp;
+            break;
+        default:
+            addr = NOVA_AC(sim, ni->mode) + ni->disp;
+            break;
+        }
+        NOVA_STEPS(&nt, 1);
+
+        if (ni->indirect) {
+            if (addr >= MEMORY_TOP) return FALSE;
+            ptr = addr;
+            addr = mem[ptr];
+            NOVA_LOAD_MAR(&nt);
+            NOVA_STEPS(&nt, 1);
+            NOVA_TASK(&nt);
+            NOVA_READ_MD(&nt);
+        } else {
+            NOVA_TASK(&nt);
+            NOVA_STEPS(&nt, 1);
+        }
+        NOVA_STEPS(&nt, 1);
+
+        switch (ni->op) {
+        case BLK_OP_JMP:
+            NOVA_TASK(&nt);
+            NOVA_STEPS(&nt, 2);
+            break;
+        case BLK_OP_JSR:
+            NOVA_STEPS(&nt, 2);
+            NOVA_TASK(&nt);
+            NOVA_STEPS(&nt, 2);
+            break;
+        case BLK_OP_ISZ:
+        case BLK_OP_DSZ:
+            if (addr >= MEMORY_TOP) return FALSE;
+            value = mem[addr] + ((ni->op == BLK_OP_ISZ) ? 1 : -1);
+            skip = (value == 0);
+            NOVA_LOAD_MAR(&nt);
+            NOVA_STEPS(&nt, 1);
+            NOVA_READ_MD(&nt);
+            NOVA_LOAD_MAR(&nt);
+            NOVA_STEPS(&nt, 1);
+            if (skip) {
+                NOVA_STORE_MD(&nt);
+                NOVA_TASK(&nt);
+                NOVA_STEPS(&nt, 2);
+            } else {
+                NOVA_TASK(&nt);
+                NOVA_STEPS(&nt, 1);
+                NOVA_STORE_MD(&nt);
+            }
+            break;
+        case BLK_OP_LDA:
+            if (addr >= MEMORY_TOP) return FALSE;
+            NOVA_LOAD_MAR(&nt);
+            NOVA_STEPS(&nt, 1);
+            NOVA_TASK(&nt);
+            NOVA_READ_MD(&nt);
+            NOVA_STEPS(&nt, 1);
+            break;
+        default: /* BLK_OP_STA */
+            if (addr >= MEMORY_TOP) return FALSE;
+            NOVA_LOAD_MAR(&nt);
+            NOVA_STEPS(&nt, 1);
+            NOVA_TASK(&nt);
+            NOVA_STEPS(&nt, 1);
+            NOVA_STORE_MD(&nt);
+            break;
+        }
+    }
+
+    /* The wakeups are only looked at by the microinstructions with TASK,
+     * so the timers that expire after the last one of them (which are
+     * dispatched by check_for_interrupts() at the correct cycle anyway)
+     * do not change how the instruction is executed.
+     */
+    if (sim->sched.next_cycle >= 0
+        && sim->sched.next_cycle < sim->cycle + nt.task_cycles)
+        return FALSE;
+
+    sim->cycle += nt.cycles;
+    sim->task_cycle[TASK_EMULATOR] += nt.cycles;
+    sim->mem_cycle = nt.mem_cycle;
+    sim->ir = ni->insn;
+    sim->ir_loads++;
+    sim->skip = FALSE;
+    sim->task_switch = FALSE;
+
+    if (ni->op == BLK_OP_ALU) {
+        native_nova_alu(sim, ni->insn, pc);
+        return TRUE;
+    }
+
+    /* The microcode keeps the address of the pointer in R7 and the
+     * effective address in R5.
+     */
+    if (ni->indirect) sim->r[7] = ptr;
+    sim->r[5] = addr;
+
+    switch (ni->op) {
+    case BLK_OP_JMP:
+        sim->r[6] = addr;
+        break;
+    case BLK_OP_JSR:
+        NOVA_AC(sim, 3) = pc + 1;
+        sim->r[6] = addr;
+        break;
+    case BLK_OP_ISZ:
+    case BLK_OP_DSZ:
+        simulator_write(sim, addr, value, TASK_EMULATOR, FALSE);
+        sim->r[5] = value;
+        sim->r[6] = pc + (skip ? 2 : 1);
+        break;
+    case BLK_OP_LDA:
+        NOVA_AC(sim, ni->ac) = mem[addr];
+        sim->r[6] = pc + 1;
+        break;
+    default: /* BLK_OP_STA */
+        sim->r[5] = NOVA_AC(sim, ni->ac);
+        simulator_write(sim, addr, sim->r[5], TASK_EMULATOR, FALSE);
+        sim->r[6] = pc + 1;
+        break;
+    }
+    return TRUE;
+}
+
+/* Executes natively the nova instructions that the emulator task is
+ * about to fetch (the emulator must be at the START of its main loop,
+ * which the caller checks). The instructions are executed one basic
+ * block at a time, with the block translated once and kept in the
+ * block cache (see blkcache.h).
+ * Only the arithmetic and logic, jump and memory reference instructions
+ * are executed here, and only when the emulator would run them without
+ * being preempted: the emulator must be the only task with a pending
+ * wakeup, and there must be no pending nova interrupts. Since these
+ * instructions do not touch the wakeups or the nova interrupts, the
+ * block only stops early when a timer expires (see native_nova_insn())
+ * or when the page of the block is written.
+ * Returns TRUE if some instruction was executed.
+ */
+static
+int native_nova(struct simulator *sim)
+{
+    const struct nova_block *blk;
+    const uint16_t *mem;
+    unsigned int bank, i;
+    uint16_t pc;
+
+    if (!sim->std_rom) return FALSE;
+    if (sim->ctask != TASK_EMULATOR || sim->ntask != TASK_EMULATOR)
+        return FALSE;
+    if (sim->sched.pending != (1U << TASK_EMULATOR)) return FALSE;
+    if (sim->r[4] != 0) return FALSE; /* NWW */
+    if (sim->rdram || sim->wrtram || sim->soft_reset) return FALSE;
+
+    pc = sim->r[6] + (sim->skip ? 1 : 0);
+    if (pc >= MEMORY_TOP) return FALSE;
+
+    bank = (sim->xm_banks[TASK_EMULATOR] >> 2) & 0x3;
+    mem = &sim->mem[bank * MEMORY_SIZE];
+    blk = blkcache_lookup(&sim->bc, bank, pc, mem, MEMORY_TOP);
+    if (!blk) return FALSE;
+
+    for (i = 0; i < blk->num_insns; i++) {
+        if (!native_nova_insn(sim, &blk->insns[i], pc + i, mem)) break;
+
+        /* The rest of the block is stale after a write to its page. */
+        if (unlikely(!BLKCACHE_VALID(&sim->bc, blk))) {
+            i++;
+            break;
+        }
+    }
+    return (i > 0);
+}
+
+/* Transfers the words of the current disk record natively.
+ * This is called when the disk word task is at the head of its transfer
+ * loop (DISK_WORD_LOOP_MPC), where R33 has the address of the last word
+ * transferred (the words are transferred downwards), R31 the address of
+ * the last word of the record, and R32 the running checksum. The words
+ * that the microcode would have transferred before the last one of the
+ * record are copied at once between the disk sector and the memory, as
+ * if they had passed under the head instantly. The microcode then goes
+ * on with the word in KDATA, the last word and the checksum as usual.
+ */
+static
+void native_disk_word(struct simulator *sim)
+{
+    uint16_t *words;
+    uint16_t count, remaining, addr, w;
+    uint16_t i, n;
+    int is_write;
+
+    if (!sim->std_rom) return;
+    if (sim->ctask != TASK_DISK_WORD) return;
+
+    words = disk_pending_words(&sim->dsk, &count, &is_write);
+    if (!words) return;
+
+    addr = sim->r[27]; /* R33 */
+    if (addr > MEMORY_TOP || sim->r[25] >= addr) return;
+    remaining = addr - sim->r[25]; /* R31 */
+
+    /* The microcode still transfers one more word of the record. */
+    n = MIN(count, remaining - 1);
+    if (is_write) n = MIN(n, count - 1);
+    if (n == 0) return;
+
+    for (i = 0; i < n; i++) {
+        addr--;
+        if (is_write) {
+            w = simulator_read(sim, addr, TASK_DISK_WORD, FALSE);
+            words[i] = w;
+        } else {
+            /* The first word was already read into KDATA. */
+            w = (i == 0) ? disk_read_kdata(&sim->dsk) : words[i - 1];
+            simulator_write(sim, addr, w, TASK_DISK_WORD, FALSE);
+        }
+        sim->r[26] ^= w; /* R32 */
+    }
+    sim->r[27] = addr;
+    disk_skip_words(&sim->dsk, n);
+}
+
+/* Fetches the predecoded microinstruction from the cache. Each
+ * microcode address has MC_CACHE_WAYS entries, decoded for different
+ * tasks. When none of them matches the current task and the MIR (for
+ * instance, right after a reset), the most recently decoded entry is
+ * kept in the second way and the first one is decoded again.
+ * The system type is given by `sys_type`.
+ * Returns the entry of the cache.
+ */
+static __inline__
+struct mc_entry *fetch_mc_entry(struct simulator *sim,
+                                enum system_type sys_type)
+{
+    struct mc_entry *e;
+
+    e = &sim->mc_cache[MC_CACHE_WAYS * sim->mpc];
+    if (likely(e->mc.task == sim->ctask && e->mc.mcode == sim->mir))
+        return e;
+    if (e[1].mc.task == sim->ctask && e[1].mc.mcode == sim->mir)
+        return &e[1];
+
+    e[1] = e[0];
+    microcode_predecode(&e->mc,
+                        sys_type,
+                        sim->mpc,
+                        sim->mir,
+                        sim->ctask);
+    bind_handlers(sim, e);
+    return e;
+}
+
+/* Executes the predecoded microinstruction in the entry `e` (the
+ * cycles were already updated). The system type is given by `sys_type`,
+ * and `soft_reset` tells if a soft reset is to be performed at the end
+ * of the step.
+ */
+static __always_inline__
+void exec_entry(struct simulator *sim, struct mc_entry *e,
+                enum system_type sys_type, int soft_reset)
+{
+    const struct microcode *mc;
+    uint16_t modified_rsel;
+    uint16_t bus;
+    uint16_t alu;
+    uint16_t shifter_output;
+    uint16_t next_extra;
+    uint8_t nntask;
+    int aluC0;
+    int nova_carry;
+    int load_r;
+    int swmode;
+
+    mc = &e->mc;
+
+    load_r = (!mc->use_constant && mc->bs == BS_LOAD_R);
+
+    /* Obtain the rsel (which might be modified by some F2
+     * functions when in the EMULATOR task.
+     */
+    modified_rsel = get_modified_rsel(sim, mc);
+
+    /* Compute the bus (pending reads from the microcode RAM are
+     * only handled by the generic handler).
+     */
+    if (unlikely(sim->rdram)) {
+        bus = read_bus(sim, mc, modified_rsel);
+    } else {
+        bus = (*e->read_bus)(sim, mc, modified_rsel);
+    }
+    if (sim->error) return;
+
+    /* Compute the ALU. */
+    alu = (*e->compute_alu)(sim, mc, bus, &aluC0);
+    if (sim->error) return;
+
+    /* Perform pending writes to the microcode RAM. */
+    do_wrtram(sim, alu);
+
+    /* Compute the shifter output. */
+    shifter_output = (*e->do_shift)(sim, mc, &load_r, &nova_carry);
+
+    /* Compute the F1 function. */
+    (*e->do_f1)(sim, mc, bus, alu, &nntask, &swmode);
+    if (sim->error) return;
+
+    /* Compute the F2 function. */
+    next_extra = (*e->do_f2)(sim, mc, bus, shifter_output, nova_carry);
+    if (sim->error) return;
+
+    /* Perform the BLOCK operation. */
+    if (mc->f1 == F1_BLOCK) do_block(sim, mc->task);
+
+    /* Write back the registers. */
+    wb_registers(sim, mc, modified_rsel, load_r,
+                 bus, alu, shifter_output, aluC0);
+
+    /* Update the micro program counter and the next task. */
+    update_program_counters(sim, sys_type, next_extra, nntask, swmode);
+
+    /* Perform the soft reset. */
+    if (soft_reset) do_soft_reset(sim);
+
+    check_for_interrupts(sim);
+}
+
+/* Spends the stall of the emulator task (the cycles charged by
+ * native_bitblt()). The stall only runs in one go while the emulator
+ * task is the only one waiting to run, and it stops right after the
+ * next timer event (which is then dispatched). Otherwise the microcode
+ * of the emulator (the jump to itself) runs as usual until the other
+ * tasks take over, and its cycles are also taken from the stall. In the
+ * single step mode, only one cycle is spent per step.
+ * Returns TRUE if the step was spent in the stall.
+ */
+static
+int stall_emulator(struct simulator *sim)
+{
+    int64_t num_cycles;
+
+    if (sim->ctask != TASK_EMULATOR) return FALSE;
+    if (sim->ntask != TASK_EMULATOR || sim->soft_reset
+        || sim->sched.pending != (1 << TASK_EMULATOR)) {
+        sim->bitblt_stall--;
+        return FALSE;
+    }
+
+    num_cycles = sim->bitblt_stall;
+    if (sim->single_step) num_cycles = 1;
+    if (sim->sched.next_cycle >= 0) {
+        num_cycles = MIN(num_cycles,
+                         sim->sched.next_cycle - sim->cycle + 1);
+    }
+
+    advance_cycles(sim, (uint32_t) num_cycles);
+    sim->bitblt_stall -= (uint32_t) num_cycles;
+    check_for_interrupts(sim);
+    return TRUE;
+}
+
+/* Performs a simulation step.
+ * The system type is given by `sys_type`. This function is always
+ * inlined with a constant `sys_type` (see the functions below), so
+ * the checks for the system type are resolved at compile time.
+ */
+static __always_inline__
+void do_step(struct simulator *sim, enum system_type sys_type)
+{
+    struct mc_entry *e;
+    int soft_reset;
+
+    if (sim->error) {
+        report_error("simulator: step: "
+                     "simulator is in error state");
+        return;
+    }
+
+    if (unlikely(sim->bitblt_stall != 0)) {
+        if (stall_emulator(sim)) return;
+    }
+
+    if (sys_type != ALTO_I && unlikely(sim->native_nova)
+        && sim->mpc == NOVA_START_MPC && !sim->single_step) {
+        if (native_nova(sim)) {
+            check_for_interrupts(sim);
+            return;
+        }
+    }
+
+    if (sys_type != ALTO_I && unlikely(sim->native_disk)
+        && sim->mpc == DISK_WORD_LOOP_MPC && !sim->single_step) {
+        native_disk_word(sim);
+    }
+
+    /* Updates the cycles. */
+    update_cycles(sim);
+
+    /* The Ethernet cycle needs to run ethernet_before_step() before*
+     * every step.
+     */
+    if (sim->ctask == TASK_ETHERNET) {
+        ethernet_before_step(&sim->ether);
+    }
+
+    /* Copy the soft_reset in a local variable. */
+    soft_reset = sim->soft_reset;
+    sim->soft_reset = FALSE;
+
+    /* Fetch the predecoded microinstruction. */
+    e = fetch_mc_entry(sim, sys_type);
+    exec_entry(sim, e, sys_type, soft_reset);
+}
+
+/* Performs a simulation step on the Alto I. */
+static
+void step_alto_i(struct simulator *sim)
+{
+    do_step(sim, ALTO_I);
+}
+
+/* Performs a simulation step on the Alto II (1K rom). */
+static
+void step_alto_ii_1krom(struct simulator *sim)
+{
+    do_step(sim, ALTO_II_1KROM);
+}
+
+/* Performs a simulation step on the Alto II (2K rom). */
+static
+void step_alto_ii_2krom(struct simulator *sim)
+{
+    do_step(sim, ALTO_II_2KROM);
+}
+
+/* Performs a simulation step on the Alto II (3K ram). */
+static
+void step_alto_ii_3kram(struct simulator *sim)
+{
+    do_step(sim, ALTO_II_3KRAM);
+}
+
+void simulator_step(struct simulator *sim)
+{
+    (*sim->step)(sim);
+}
+
+/* Saves the state of the simulator at the head of a loop.
+ * The state is written to `lh`.
+ */
+static
+void save_loop_head(const struct simulator *sim, struct loop_head *lh)
+{
+    /* Clear the padding too, so that the structure can be compared
+     * with memcmp().
+     */
+    memset(lh, 0, sizeof(struct loop_head));
+
+    memcpy(lh->r, sim->r, NUM_R_REGISTERS * sizeof(uint16_t));
+    lh->t = sim->t;
+    lh->l = sim->l;
+    lh->m = sim->m;
+    lh->mar = sim->mar;
+    lh->ir = sim->ir;
+    lh->mir = sim->mir;
+    lh->mpc = sim->mpc;
+    lh->emu_mpc = sim->task_mpc[TASK_EMULATOR];
+    lh->rmr = sim->rmr;
+    lh->cram_addr = sim->cram_addr;
+    lh->xm_bank = sim->xm_banks[TASK_EMULATOR];
+    lh->srb = sim->sreg_banks[TASK_EMULATOR];
+    lh->ctask = sim->ctask;
+    lh->ntask = sim->ntask;
+    lh->mem_task = sim->mem_task;
+    lh->mem_cycle = sim->mem_cycle;
+    lh->mem_low = sim->mem_low;
+    lh->mem_high = sim->mem_high;
+    lh->mem_status = sim->mem_status;
+    lh->task_switch = sim->task_switch;
+    lh->aluC0 = sim->aluC0;
+    lh->skip = sim->skip;
+    lh->carry = sim->carry;
+    lh->rdram = sim->rdram;
+    lh->wrtram = sim->wrtram;
+    lh->soft_reset = sim->soft_reset;
+    lh->intr_cycle = sim->sched.next_cycle;
+    lh->side_effects = sim->side_effects;
+}
+
+/* Checks the nova loops after a backward jump to `pc`.
+ * The loop head is kept while the program keeps coming back to it (even
+ * with other tasks running in between), and the iteration is idle when
+ * the accumulators and carry are the same as in the previous one, and
+ * the emulator did not change the memory. The result is kept in `idl`.
+ */
+static
+void check_nova_loop(struct simulator *sim, struct idle_detector *idl,
+                     uint16_t pc)
+{
+    struct nova_loop nl;
+    unsigned int i;
+
+    if (pc != idl->nova.pc) {
+        if (sim->ir_loads - idl->nova_loads <= IDLE_LOOP_LENGTH)
+            return;
+
+        /* Assume this is the head of a new loop. */
+        idl->idle = FALSE;
+    }
+
+    memset(&nl, 0, sizeof(struct nova_loop));
+    nl.pc = pc;
+    for (i = 0; i < 4; i++)
+        nl.ac[i] = sim->r[i];
+    nl.carry = sim->carry;
+    nl.mem_changes = sim->mem_changes;
+
+    if (pc == idl->nova.pc) {
+        idl->idle = (memcmp(&nl, &idl->nova, sizeof(struct nova_loop)) == 0);
+    }
+    idl->nova = nl;
+    idl->nova_loads = sim->ir_loads;
+}
+
+/* Checks if the emulator task is idle, and if so, skips the iterations
+ * of the idle loop up to the next device event.
+ * This should be called after every nova instruction is loaded (in the
+ * IR register), and the state of the detection is kept in `idl`.
+ * The emulator is idle when it returns to the head of a loop (a
+ * backward jump of the nova PC) with exactly the same state, with no
+ * other task pending and without side effects in between. Since the
+ * execution is deterministic, the loop will repeat itself until the
+ * next interrupt, so whole iterations can be skipped by just advancing
+ * the cycle counters. No more than `max_skip` cycles are skipped.
+ * Returns the number of cycles skipped.
+ */
+static
+int64_t skip_idle_loop(struct simulator *sim, struct idle_detector *idl,
+                       int64_t max_skip)
+{
+    struct loop_head lh;
+    int64_t period, avail, skip;
+    uint16_t pc, last_pc;
+
+    /* The nova PC is kept in R6. */
+    pc = sim->r[6];
+    last_pc = idl->last_pc;
+    idl->last_pc = pc;
+
+    if (pc <= last_pc) check_nova_loop(sim, idl, pc);
+
+    if (sim->sched.pending != (1 << TASK_EMULATOR)) {
+        idl->valid = FALSE;
+        return 0;
+    }
+
+    if (idl->valid && pc == idl->head_pc) {
+        save_loop_head(sim, &lh);
+        if (memcmp(&lh, &idl->head, sizeof(struct loop_head)) != 0) {
+            /* Not idle, start over from this iteration. */
+            idl->head = lh;
+            idl->cycle = sim->cycle;
+            return 0;
+        }
+
+        period = sim->cycle - idl->cycle;
+        avail = max_skip;
+        if (sim->sched.next_cycle >= 0) {
+            /* Do not go past the next interrupt. */
+            avail = MIN(avail, sim->sched.next_cycle - sim->cycle);
+        }
+        if (period == 0 || avail < period) return 0;
+
+        skip = (avail / period) * period;
+        sim->cycle += skip;
+        sim->task_cycle[TASK_EMULATOR] += skip;
+        idl->cycle = sim->cycle;
+        return skip;
+    }
+
+    if (pc <= last_pc) {
+        /* A backward jump: this might be the head of a loop. */
+        save_loop_head(sim, &idl->head);
+        idl->head_pc = pc;
+        idl->cycle = sim->cycle;
+        idl->valid = TRUE;
+    }
+    return 0;
+}
+
+/* Updates the count of idle fields at the end of a display field.
+ * The emulator is idle for the whole field when it ends the field
+ * spinning idle in the same loop, with the same state (and without
+ * changing the memory), as it ended the previous field, and it polled
+ * the keyboard or the mouse in the meantime (so it is waiting for input,
+ * and not for time to pass).
+ */
+static
+void update_idle_fields(struct simulator *sim, struct idle_detector *idl)
+{
+    int polled;
+
+    polled = (sim->input_polls != idl->field_polls);
+    idl->field_polls = sim->input_polls;
+    if (!idl->idle) {
+        idl->field_valid = FALSE;
+        idl->idle_fields = 0;
+        return;
+    }
+
+    if (idl->field_valid && polled
+        && memcmp(&idl->nova, &idl->field_nova,
+                  sizeof(struct nova_loop)) == 0) {
+        idl->idle_fields++;
+    } else {
+        idl->idle_fields = 0;
+    }
+    idl->field_nova = idl->nova;
+    idl->field_valid = TRUE;
+}
+
+int64_t simulator_run(struct simulator *sim, int64_t max_cycles,
+                      unsigned int stop_flags, unsigned int *reason)
+{
+    void (*step)(struct simulator *sim);
+    struct idle_detector *idl;
+    int64_t start_cycle;
+    int64_t cycles;
+    int check_field, even_field;
+
+    step = sim->step;
+    idl = sim->idl;
+    idl->ir_loads = sim->ir_loads;
+    idl->last_pc = sim->r[6];
+    idl->valid = FALSE;
+    start_cycle = sim->cycle;
+    check_field = ((stop_flags & SIM_STOP_FIELD) != 0);
+    even_field = sim->displ.even_field;
+
+    *reason = SIM_STOP_CYCLES;
+    cycles = 0;
+    if (unlikely(sim->error)) {
+        *reason = SIM_STOP_ERROR;
+        return cycles;
+    }
+
+    while (cycles < max_cycles) {
+        (*step)(sim);
+        cycles = sim->cycle - start_cycle;
+
+        if (unlikely(sim->error)) {
+            *reason = SIM_STOP_ERROR;
+            break;
+        }
+
+        if (sim->displ.even_field != even_field) {
+            even_field = sim->displ.even_field;
+            update_idle_fields(sim, idl);
+            if (check_field) {
+                *reason = SIM_STOP_FIELD;
+                break;
+            }
+        }
+
+        if (sim->ir_loads != idl->ir_loads) {
+            idl->ir_loads = sim->ir_loads;
+            if (cycles < max_cycles) {
+                skip_idle_loop(sim, idl, max_cycles - cycles);
+                cycles = sim->cycle - start_cycle;
+            }
+        }
+    }
+
+    return cycles;
+}
+
+int simulator_is_idle(const struct simulator *sim)
+{
+    return (sim->idl->idle_fields >= IDLE_FIELDS);
+}
+
+int simulator_update(struct simulator *sim,
+                     const struct keyboard *keyb,
+                     const struct mouse *mous,
+                     struct display_line *lines,
+                     uint32_t *dirty)
+{
+    if (lines) {
+        display_copy_dirty(&sim->displ, lines, dirty);
+    }
+    if (keyb) {
+        keyboard_update_from(&sim->keyb, keyb);
+    }
+    if (mous) {
+        mouse_update_from(&sim->mous, mous);
+    }
+    return TRUE;
+}
+
+void simulator_predecode(const struct simulator *sim,
+                         struct microcode *mc)
+{
+    microcode_predecode(mc,
+                        sim->sys_type,
+                        sim->mpc,
+                        sim->mir,
+                        sim->ctask);
+}
+
+void simulator_nova_predecode(const struct simulator *sim,
+                              struct nova_insn *ni)
+{
+    uint16_t address, insn;
+
+    address = sim->r[6];
+    insn = simulator_read(sim, address, TASK_EMULATOR, FALSE);
+    nova_insn_predecode(ni, address, insn);
+}
+
+void simulator_print_registers(const struct simulator *sim,
+                               struct decoder *dec)
+{
+    struct string_buffer *output;
+    uint16_t pending;
+    unsigned int i;
+
+    output = dec->output;
+    decode_tagged_value(dec->vdec, "T", DECODE_VALUE, sim->t);
+    decode_tagged_value(dec->vdec, "L", DECODE_VALUE, sim->l);
+    decode_tagged_value(dec->vdec, "MAR", DECODE_MEMORY, sim->mar);
+    decode_tagged_value(dec->vdec, "IR", DECODE_VALUE, sim->ir);
+    string_buffer_print(output, "\n");
+
+    for (i = 0; i < NUM_R_REGISTERS; i++) {
         decode_value_padded(dec->vdec, DECODE_REG, i, 9);
         string_buffer_print(output, ": ");
         decode_value_padded(dec->vdec, DECODE_VALUE, sim->r[i], 11);
@@ -1824,18 +3435,16 @@ void simulator_print_registers(const struct simulator *sim,
         }
     }
 
-    pending = get_pending(sim);
+    pending = sim->sched.pending;
     decode_tagged_value(dec->vdec, "ALUC0", DECODE_BOOL, sim->aluC0);
     decode_tagged_value(dec->vdec, "CARRY", DECODE_BOOL, sim->carry);
     decode_tagged_value(dec->vdec, "SKIP", DECODE_BOOL, sim->skip);
     decode_tagged_value(dec->vdec, "PEND", DECODE_VALUE, pending);
     string_buffer_print(output, "\n");
 
-    decode_tagged_value(dec->vdec, "CYC", DECODE_SVALUE32, sim->cycle);
-    decode_tagged_value(dec->vdec, "ICYC",
-                        DECODE_SVALUE32, sim->intr_cycle);
-    decode_tagged_value(dec->vdec, "TASKCYC", DECODE_SVALUE32,
-                        sim->task_cycle[sim->ctask]);
+    decode_tagged_cycle(dec->vdec, "CYC", sim->cycle);
+    decode_tagged_cycle(dec->vdec, "ICYC", sim->sched.next_cycle);
+    decode_tagged_cycle(dec->vdec, "TASKCYC", sim->task_cycle[sim->ctask]);
     decode_tagged_value(dec->vdec, "MEMCYC",
                         DECODE_SVALUE32, sim->mem_cycle);
     string_buffer_print(output, "\n");
@@ -1910,6 +3519,8 @@ void simulator_print_nova_registers(const struct simulator *sim,
 
 void simulator_serialize(const struct simulator *sim, struct serdes *sd)
 {
+    serdes_put32(sd, STATE_MAGIC);
+    serdes_put32(sd, STATE_VERSION);
     serdes_put32(sd, (uint32_t) sim->sys_type);
     serdes_put_bool(sd, sim->error);
     serdes_put16_array(sd, sim->r, NUM_R_REGISTERS);
@@ -1919,7 +3530,7 @@ void simulator_serialize(const struct simulator *sim, struct serdes *sd)
     serdes_put16(sd, sim->m);
     serdes_put16(sd, sim->mar);
     serdes_put16(sd, sim->ir);
-    serdes_put16(sd, sim->mir);
+    serdes_put32(sd, sim->mir);
     serdes_put16(sd, sim->mpc);
     serdes_put8(sd, sim->ctask);
     serdes_put8(sd, sim->ntask);
@@ -1937,10 +3548,10 @@ void simulator_serialize(const struct simulator *sim, struct serdes *sd)
     serdes_put32_array(sd, sim->microcode,
                        NUM_MICROCODE_BANKS * MICROCODE_SIZE);
     serdes_put16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
-    serdes_put32(sd, sim->cycle);
-    serdes_put32_array(sd, (const uint32_t *) sim->task_cycle,
+    serdes_put64(sd, sim->cycle);
+    serdes_put64_array(sd, (const uint64_t *) sim->task_cycle,
                        TASK_NUM_TASKS);
-    serdes_put32(sd, sim->intr_cycle);
+    serdes_put64(sd, sim->sched.next_cycle);
     serdes_put16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
     serdes_put16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
     serdes_put8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
@@ -1949,6 +3560,7 @@ void simulator_serialize(const struct simulator *sim, struct serdes *sd)
     serdes_put16(sd, sim->mem_low);
     serdes_put16(sd, sim->mem_high);
     serdes_put16(sd, sim->mem_status);
+    serdes_put32(sd, sim->bitblt_stall);
     disk_serialize(&sim->dsk, sd);
     display_serialize(&sim->displ, sd);
     ethernet_serialize(&sim->ether, sd);
@@ -1958,7 +3570,13 @@ void simulator_serialize(const struct simulator *sim, struct serdes *sd)
 
 void simulator_deserialize(struct simulator *sim, struct serdes *sd)
 {
+    /* The magic number and the version (already checked by
+     * simulator_load_state()).
+     */
+    serdes_get32(sd);
+    serdes_get32(sd);
     sim->sys_type = (enum system_type) serdes_get32(sd);
+    select_step(sim);
     sim->error = serdes_get_bool(sd);
     serdes_get16_array(sd, sim->r, NUM_R_REGISTERS);
     serdes_get16_array(sd, sim->s, NUM_S_BANKS * NUM_S_REGISTERS);
@@ -1967,7 +3585,7 @@ void simulator_deserialize(struct simulator *sim, struct serdes *sd)
     sim->m = serdes_get16(sd);
     sim->mar = serdes_get16(sd);
     sim->ir = serdes_get16(sd);
-    sim->mir = serdes_get16(sd);
+    sim->mir = serdes_get32(sd);
     sim->mpc = serdes_get16(sd);
     sim->ctask = serdes_get8(sd);
     sim->ntask = serdes_get8(sd);
@@ -1984,24 +3602,38 @@ void simulator_deserialize(struct simulator *sim, struct serdes *sd)
     serdes_get16_array(sd, sim->consts, CONSTANT_SIZE);
     serdes_get32_array(sd, sim->microcode,
                        NUM_MICROCODE_BANKS * MICROCODE_SIZE);
+    invalidate_mc_cache(sim, 0, NUM_MICROCODE_BANKS * MICROCODE_SIZE);
     serdes_get16_array(sd, sim->task_mpc, TASK_NUM_TASKS);
-    sim->cycle = serdes_get32(sd);
-    serdes_get32_array(sd, (uint32_t *) sim->task_cycle,
+    sim->cycle = (int64_t) serdes_get64(sd);
+    serdes_get64_array(sd, (uint64_t *) sim->task_cycle,
                        TASK_NUM_TASKS);
-    sim->intr_cycle = serdes_get32(sd);
+    serdes_get64(sd); /* The next interrupt cycle (recomputed). */
+    intr_reset(&sim->sched);
     serdes_get16_array(sd, sim->mem, NUM_MEMORY_BANKS * MEMORY_SIZE);
+    blkcache_flush(&sim->bc);
     serdes_get16_array(sd, sim->xm_banks, TASK_NUM_TASKS);
+    update_mem_bases(sim);
     serdes_get8_array(sd, sim->sreg_banks, TASK_NUM_TASKS);
     sim->mem_cycle = serdes_get16(sd);
     sim->mem_task = serdes_get8(sd);
     sim->mem_low = serdes_get16(sd);
     sim->mem_high = serdes_get16(sd);
     sim->mem_status = serdes_get16(sd);
+    sim->bitblt_stall = serdes_get32(sd);
     disk_deserialize(&sim->dsk, sd);
     display_deserialize(&sim->displ, sd);
     ethernet_deserialize(&sim->ether, sd);
     keyboard_deserialize(&sim->keyb, sd);
     mouse_deserialize(&sim->mous, sd);
+
+    /* The idle detection starts over with the new state. */
+    sim->idl->valid = FALSE;
+    sim->idl->nova.pc = 0xFFFF;
+    sim->idl->nova_loads = 0;
+    sim->idl->idle = FALSE;
+    sim->idl->field_valid = FALSE;
+    sim->idl->field_polls = 0;
+    sim->idl->idle_fields = 0;
 }
 
 int simulator_save_state(const struct simulator *sim,
@@ -2041,6 +3673,8 @@ int simulator_load_state(struct simulator *sim,
                          const char *filename)
 {
     struct serdes sd;
+    size_t size;
+    uint32_t magic, version, sys_type;
 
     if (unlikely(!serdes_create(&sd, STATE_SIZE, FALSE))) {
         report_error("simulator: load_state: "
@@ -2055,7 +3689,22 @@ int simulator_load_state(struct simulator *sim,
         return FALSE;
     }
 
-    if (unlikely(sd.pos != sd.size)) {
+    /* Check the header first (the size changes between versions). */
+    size = sd.pos;
+    serdes_rewind(&sd);
+    magic = serdes_get32(&sd);
+    version = serdes_get32(&sd);
+    if (unlikely(magic != STATE_MAGIC || version != STATE_VERSION)) {
+        report_error("simulator: load_state: "
+                     "unsupported state file `%s` (expecting version %d)",
+                     filename, STATE_VERSION);
+        serdes_destroy(&sd);
+        return FALSE;
+    }
+
+    /* The system type selects the simulation step. */
+    sys_type = serdes_get32(&sd);
+    if (unlikely(size != sd.size || sys_type > ALTO_II_3KRAM)) {
         report_error("simulator: load_state: "
                      "invalid state file `%s`", filename);
         serdes_destroy(&sd);
@@ -5,6 +5,9 @@
 #include <stdint.h>
 #include "microcode/microcode.h"
 #include "microcode/nova.h"
+#include "simulator/intr.h"
+#include "simulator/bitblt.h"
+#include "simulator/blkcache.h"
 #include "simulator/disk.h"
 #include "simulator/display.h"
 #include "simulator/ethernet.h"
@@ -13,12 +16,70 @@
 #include "common/serdes.h"
 #include "common/string_buffer.h"
 
+/* Constants. */
+
+/* Reasons for simulator_run() to stop. Except for SIM_STOP_CYCLES and
+ * SIM_STOP_ERROR (which always stop the simulation), these are also the
+ * flags that enable each stop condition.
+ */
+#define SIM_STOP_CYCLES                 0x00 /* Cycle budget used up. */
+#define SIM_STOP_ERROR                  0x01 /* Simulator in error state. */
+#define SIM_STOP_FIELD                  0x02 /* Display field completed. */
+
 /* Data structures and types. */
 
-/* Structure representing an Alto simulator. */
+/* Forward declarations. */
+struct simulator;
+struct idle_detector;
+
+/* Possible execution engines for the simulator. */
+enum sim_engine {
+    SIM_ENGINE_INTERPRETER,       /* Generic (switch based) stages. */
+    SIM_ENGINE_THREADED,          /* Per-opcode handlers bound when the
+                                   * microinstruction is decoded.
+                                   */
+};
+
+/* Structure representing an entry of the predecoded microcode cache. */
+struct mc_entry {
+    struct microcode mc;          /* The predecoded microinstruction. */
+
+    /* Handlers for the stages of the microinstruction. They are bound
+     * when the entry is decoded, according to the execution engine.
+     */
+    uint16_t (*read_bus)(struct simulator *sim,
+                         const struct microcode *mc,
+                         uint16_t modified_rsel);
+    uint16_t (*compute_alu)(struct simulator *sim,
+                            const struct microcode *mc,
+                            uint16_t bus, int *carry);
+    uint16_t (*do_shift)(struct simulator *sim,
+                         const struct microcode *mc,
+                         int *load_r, int *nova_carry);
+    void (*do_f1)(struct simulator *sim,
+                  const struct microcode *mc,
+                  uint16_t bus, uint16_t alu,
+                  uint8_t *nntask, int *swmode);
+    uint16_t (*do_f2)(struct simulator *sim,
+                      const struct microcode *mc,
+                      uint16_t bus, uint16_t shifter_output,
+                      int nova_carry);
+};
+
+/* Structure representing an Alto simulator.
+ * The fields used in every cycle come first, so that they share the
+ * first few cache lines. The arrays of the state are allocated together
+ * in one arena (see struct sim_arena), also with the hottest first.
+ */
 struct simulator {
-    enum system_type sys_type;    /* The alto system type. */
-    int error;                    /* The simulator is in an error state. */
+    void (*step)(struct simulator *sim);
+                                  /* The step function (specialized for
+                                   * the system type).
+                                   */
+    struct mc_entry *mc_cache;    /* Predecoded microcode (two entries per
+                                   * word of the microcode ROM + RAM, for
+                                   * different tasks).
+                                   */
     uint16_t *r;                  /* R register file (32 registers). */
     uint16_t *s;                  /* S register file (8 x 32 registers). */
 
@@ -38,32 +99,31 @@ struct simulator {
     int skip;                     /* Skip flag. */
     int carry;                    /* Carry flag. */
 
-    uint16_t rmr;                 /* Reset mode register (for tasks to start
-                                   * in either ROM0 or RAM0).
-                                   */
-    uint16_t cram_addr;           /* Control RAM address. */
     int rdram;                    /* Previous instruction had RDRAM. */
     int wrtram;                   /* Previous instruction had WRTRAM. */
     int soft_reset;               /* Previous instruction had soft reset. */
+    int error;                    /* The simulator is in an error state. */
 
-    uint8_t *acs_rom;             /* The contents of the ACSROM. */
-    uint16_t *consts;             /* Pointer to the constant rom. */
-    uint32_t *microcode;          /* Microcode ROM + RAM. */
+    enum sim_engine engine;       /* The execution engine. */
+    int native_nova;              /* To execute the basic nova instructions
+                                   * natively.
+                                   */
+    int native_disk;              /* To transfer the disk records
+                                   * natively.
+                                   */
+    int single_step;              /* The debugger is stepping through
+                                   * the microcode (the native paths
+                                   * are not taken).
+                                   */
 
+    int64_t cycle;                /* Current cpu cycle (it never wraps
+                                   * around).
+                                   */
+    int64_t *task_cycle;          /* Current task cycles. */
     uint16_t *task_mpc;           /* Microcode program counter + bank
                                    * select (1 per task).
                                    */
 
-    int32_t cycle;                /* Current cpu cycle. */
-    int32_t *task_cycle;          /* Current task cycles. */
-    int32_t intr_cycle;           /* Next cycle when the simulator needs
-                                   * to check the controllers for events.
-                                   */
-
-    uint16_t *mem;                /* Main memory. */
-    uint16_t *xm_banks;           /* Banks for the different tasks. */
-    uint8_t *sreg_banks;          /* S register banks for the tasks. */
-
     uint16_t mem_cycle;           /* A counter to keep track the current
                                    * memory cycle (for reading and writing).
                                    */
@@ -71,7 +131,68 @@ struct simulator {
     uint16_t mem_low;             /* Latched memory value (1st word). */
     uint16_t mem_high;            /* Latched memory value (2nd word). */
     uint16_t mem_status;          /* The status of memory operation. */
+    uint16_t **mem_base;          /* The normal memory bank of each task
+                                   * (computed from xm_banks).
+                                   */
+    uint16_t **xmem_base;         /* The extended memory bank of each
+                                   * task (computed from xm_banks).
+                                   */
+    uint8_t *sreg_banks;          /* S register banks for the tasks. */
+    uint32_t *microcode;          /* Microcode ROM + RAM. */
+    uint16_t *consts;             /* Pointer to the constant rom. */
 
+    uint32_t ir_loads;            /* Number of loads of the IR register. */
+    uint32_t side_effects;        /* Counts the changes to the state that
+                                   * are not tracked by the idle loop
+                                   * detection (memory, S registers,
+                                   * microcode RAM and devices).
+                                   */
+    uint32_t mem_changes;         /* Counts the writes that changed the
+                                   * memory contents (or the banks) done by
+                                   * the emulator task.
+                                   */
+    uint32_t input_polls;         /* Counts the reads of the keyboard and
+                                   * mouse done by the emulator task.
+                                   */
+
+    struct intr_scheduler sched;  /* Schedules the events of the
+                                   * controllers (sched.next_cycle is the
+                                   * next cycle when the simulator needs
+                                   * to check the controllers for events).
+                                   */
+
+    /* From here on, the fields are not used in every cycle. */
+    enum system_type sys_type;    /* The alto system type. */
+    uint16_t rmr;                 /* Reset mode register (for tasks to start
+                                   * in either ROM0 or RAM0).
+                                   */
+    uint16_t cram_addr;           /* Control RAM address. */
+
+    void *arena;                  /* The memory block of the arena (the
+                                   * arrays of the state point into it).
+                                   */
+    uint8_t *acs_rom;             /* The contents of the ACSROM. */
+    uint16_t *mem;                /* Main memory. */
+    uint16_t *xm_banks;           /* Banks for the different tasks. */
+    uint8_t *io_map;              /* The device of each memory mapped
+                                   * I/O address (above MEMORY_TOP).
+                                   */
+
+    struct idle_detector *idl;    /* State of the idle loop detection. */
+    struct bitblt *bb;            /* The native BITBLT operation. */
+    int native_bitblt;            /* To execute the BITBLT instruction
+                                   * natively.
+                                   */
+    uint32_t bitblt_stall;        /* The cycles of the native BITBLT
+                                   * not yet spent by the emulator task.
+                                   */
+    int std_rom;                  /* The ROM0 has the standard microcode
+                                   * (not loaded from a file).
+                                   */
+
+    struct blkcache bc;           /* The translated nova blocks (for the
+                                   * native nova instructions).
+                                   */
     struct disk dsk;              /* The disk controller. */
     struct display displ;         /* The display controller. */
     struct ethernet ether;        /* The ethernet controller. */
@@ -115,6 +236,79 @@ int simulator_load_constant_rom(struct simulator *sim,
 int simulator_load_microcode_rom(struct simulator *sim,
                                  const char *filename, uint8_t bank);
 
+/* Selects the execution engine of the simulator.
+ * The engine is given by `engine`. Both engines produce the same
+ * results, the threaded engine is just faster.
+ */
+void simulator_set_engine(struct simulator *sim, enum sim_engine engine);
+
+/* Enables the native execution of the BITBLT instruction.
+ * When `enable` is TRUE, the scanlines of the BITBLT instruction are
+ * processed directly by the simulator instead of the microcode. This
+ * only happens for the Alto II with the standard microcode in ROM0.
+ * The memory and the nova registers are left exactly as the microcode
+ * would leave them. The emulator task is charged with the approximate
+ * cost of the microcode, and only the scanlines that fit before the
+ * next timer event are processed natively (the rest are left to the
+ * microcode).
+ */
+void simulator_set_native_bitblt(struct simulator *sim, int enable);
+
+/* Enables the native execution of the basic nova instructions.
+ * When `enable` is TRUE, the arithmetic, jump and memory reference
+ * instructions are executed directly by the simulator instead of the
+ * emulator microcode, with the same effect on the nova registers, the
+ * memory and the cycle counters. The other instructions (and the ones
+ * touching the I/O area of the memory) are still executed by the
+ * microcode. This only happens for the Alto II with the standard
+ * microcode in ROM0.
+ */
+void simulator_set_native_nova(struct simulator *sim, int enable);
+
+/* Enables the native transfer of the disk records.
+ * When `enable` is TRUE, the words of a record being read or written
+ * by the disk word task are copied directly between the disk sector and
+ * the memory, instead of one word per disk word interrupt. The sector
+ * and word tasks still issue the commands, check the headers and the
+ * checksums, and post the status, so the effect on the memory and the
+ * disk is the same. The records just pass under the head faster. This
+ * only happens for the Alto II with the standard microcode in ROM0.
+ */
+void simulator_set_native_disk(struct simulator *sim, int enable);
+
+/* Enables the single step mode (for the debugger).
+ * When `enable` is TRUE, every simulation step executes exactly one
+ * microinstruction: the native BITBLT, nova and disk paths, which run
+ * the work of many microinstructions at once, are not taken.
+ */
+void simulator_set_single_step(struct simulator *sim, int enable);
+
+/* Enables the fast display mode (see display_set_fast()).
+ * When `enable` is TRUE, the display word task fills a whole scanline
+ * without being paced word by word, and the scanline is rendered in
+ * one pass. The display tasks still execute (and are charged for) the
+ * same microinstructions, but the display no longer needs an event for
+ * every 16 pixels.
+ */
+void simulator_set_fast_display(struct simulator *sim, int enable);
+
+/* Enables the fast disk mode (see disk_set_fast()).
+ * When `enable` is TRUE, the seeks and the rotational latency of the
+ * disk take no time. The KSTAT register reports the new cylinder and
+ * sector as if the drive had got there, so the microcode and the
+ * operating system see an ordinary (if very lucky) drive.
+ */
+void simulator_set_fast_disk(struct simulator *sim, int enable);
+
+/* Sets the cpu clock multiplier to `mult` (see intr_set_clock_mult()).
+ * The timing of the devices (the display, the disk and the ethernet) is
+ * stretched `mult` times in cycles, so the microcode runs `mult` times
+ * as many instructions per display field and per disk sector. To keep
+ * the display at its normal rate, the caller must also run `mult` times
+ * as many cycles per second.
+ */
+void simulator_set_clock_mult(struct simulator *sim, unsigned int mult);
+
 /* Resets the simulator. */
 void simulator_reset(struct simulator *sim);
 
@@ -138,17 +332,43 @@ void simulator_write(struct simulator *sim, uint16_t address,
 /* Performs a simulation step. */
 void simulator_step(struct simulator *sim);
 
+/* Runs the simulation for (at least) `max_cycles` cycles.
+ * The simulation stops earlier on an error, or when one of the
+ * conditions enabled in `stop_flags` (SIM_STOP_* flags) happens.
+ * When the emulator task is provably idle (spinning in a loop without
+ * side effects), the whole iterations of the loop up to the next device
+ * event are skipped at once.
+ * The reason for stopping is written to `reason`.
+ * Returns the number of cycles executed.
+ */
+int64_t simulator_run(struct simulator *sim, int64_t max_cycles,
+                      unsigned int stop_flags, unsigned int *reason);
+
+/* Checks if the emulator task is idle.
+ * The emulator is considered idle when the last display fields simulated
+ * by simulator_run() all ended with the emulator spinning in the same loop
+ * without making progress (for example, waiting for user input).
+ * Returns TRUE if the emulator is idle.
+ */
+int simulator_is_idle(const struct simulator *sim);
+
 /* Updates the input and output state of the simulation.
  * The keyboard input state is given by `keyb` and the mouse input state
- * is given by `mous`. The current pixel data from the display will be
- * copied to `display_data`. If any of these parameter is NULL, the
- * corresponding state will not be copied.
+ * is given by `mous`. The current lines of the display (see
+ * display_render_line() to obtain their pixels) will be copied to
+ * `lines`, an array of DISPLAY_HEIGHT lines. If any of these parameter
+ * is NULL, the corresponding state will not be copied.
+ * When `dirty` is not NULL, only the lines of the display that changed
+ * since the last update are copied, and they are marked in the `dirty`
+ * bitmap (see DISPLAY_SET_DIRTY). The caller clears the bits once it
+ * consumes the lines.
  * Returns TRUE on success.
  */
 int simulator_update(struct simulator *sim,
                      const struct keyboard *keyb,
                      const struct mouse *mous,
-                     uint8_t *display_data);
+                     struct display_line *lines,
+                     uint32_t *dirty);
 
 /* Predecodes the current microinstruction.
  * The output is written to `mc`.